@@ -0,0 +1,66 @@
+#include "AsyncCompute.h"
+
+#include <stdexcept>
+
+void AsyncCompute::Create(HostAllocator* hostAllocator, VkDevice device, VkQueue queue, uint32_t queueFamilyIndex, bool overlapsGraphics, uint32_t frameCount, SubmitBatcher* batcher)
+{
+	m_HostAllocator = hostAllocator;
+	m_Device = device;
+	m_Queue = queue;
+	m_Batcher = batcher;
+	m_QueueFamilyIndex = queueFamilyIndex;
+	m_OverlapsGraphics = overlapsGraphics;
+
+	m_Timeline.Create(m_HostAllocator, m_Device);
+
+	m_Frames.resize(frameCount);
+	for (auto& frame : m_Frames)
+		frame.commandAllocator.Create(m_HostAllocator, m_Device, m_QueueFamilyIndex);
+}
+
+void AsyncCompute::Destroy()
+{
+	for (auto& frame : m_Frames)
+		frame.commandAllocator.Destroy();
+	m_Frames.clear();
+
+	m_Timeline.Destroy();
+}
+
+void AsyncCompute::BeginFrame(uint32_t frameIndex)
+{
+	m_CurrentFrame = frameIndex;
+
+	FrameSlot& frame = m_Frames[m_CurrentFrame];
+	m_Timeline.Wait(frame.submittedValue);
+	frame.commandAllocator.Reset();
+}
+
+uint64_t AsyncCompute::Submit(const std::function<void(VkCommandBuffer)>& record, const std::vector<TimelineWait>& waits)
+{
+	FrameSlot& frame = m_Frames[m_CurrentFrame];
+	VkCommandBuffer commandBuffer = frame.commandAllocator.Allocate(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+		throw std::runtime_error("Failed to begin recording compute command buffer!");
+
+	record(commandBuffer);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to record compute command buffer!");
+
+	m_WaitInfos.clear();
+	for (const auto& wait : waits)
+		m_WaitInfos.push_back(SubmitBatcher::SemaphoreInfo(wait));
+
+	uint64_t signalValue = m_Timeline.Next();
+	VkSemaphoreSubmitInfo signalInfo = SubmitBatcher::SemaphoreInfo(m_Timeline.GetSemaphore(), signalValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+	m_Batcher->Add(m_Queue, { &commandBuffer, 1 }, m_WaitInfos, { &signalInfo, 1 }, &m_Timeline);
+
+	frame.submittedValue = signalValue;
+	return signalValue;
+}
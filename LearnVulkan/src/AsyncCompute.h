@@ -0,0 +1,48 @@
+#pragma once
+
+#include "CommandAllocator.h"
+#include "SubmitBatcher.h"
+#include "Timeline.h"
+
+#include <functional>
+#include <vector>
+
+// Submits compute work (culling, post-processing, ...) on its own queue so it can overlap with graphics work.
+// Submissions signal the compute timeline, and other queues wait on those values instead of on fences or idle queues.
+// Resources with VK_SHARING_MODE_EXCLUSIVE that cross queue families need the ownership transfers from Barriers.h.
+class AsyncCompute
+{
+public:
+	// overlapsGraphics is false when the device has no spare compute queue and queue is the graphics queue itself. Waits
+	// on graphics values still work then, the batcher submits the graphics work first.
+	// Submissions go through batcher, they reach the GPU with its next flush.
+	void Create(HostAllocator* hostAllocator, VkDevice device, VkQueue queue, uint32_t queueFamilyIndex, bool overlapsGraphics, uint32_t frameCount, SubmitBatcher* batcher);
+	void Destroy();
+
+	// Recycles the command buffers of frame slot frameIndex once the GPU has finished the slot's last compute work.
+	void BeginFrame(uint32_t frameIndex);
+	// Records a command buffer with record and submits it after all waits. Returns the compute timeline value it signals.
+	uint64_t Submit(const std::function<void(VkCommandBuffer)>& record, const std::vector<TimelineWait>& waits = {});
+
+	Timeline& GetTimeline() { return m_Timeline; }
+	uint32_t GetQueueFamily() const { return m_QueueFamilyIndex; }
+	bool OverlapsGraphics() const { return m_OverlapsGraphics; }
+private:
+	struct FrameSlot
+	{
+		CommandAllocator commandAllocator;
+		uint64_t submittedValue = 0;
+	};
+private:
+	HostAllocator* m_HostAllocator = nullptr;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkQueue m_Queue = VK_NULL_HANDLE;
+	SubmitBatcher* m_Batcher = nullptr;
+	uint32_t m_QueueFamilyIndex = 0;
+	bool m_OverlapsGraphics = false;
+	Timeline m_Timeline;
+	std::vector<FrameSlot> m_Frames;
+	uint32_t m_CurrentFrame = 0;
+	// Reused by every Submit() so a steady frame loop doesn't allocate.
+	std::vector<VkSemaphoreSubmitInfo> m_WaitInfos;
+};
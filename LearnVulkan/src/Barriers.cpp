@@ -0,0 +1,85 @@
+#include "Barriers.h"
+
+void RecordBufferRelease(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t srcFamily, uint32_t dstFamily,
+	VkPipelineStageFlags srcStage, VkAccessFlags srcAccess)
+{
+	// The semaphore between the two submissions already makes the writes available.
+	if (srcFamily == dstFamily)
+		return;
+
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = 0; // Ignored for a release
+	barrier.srcQueueFamilyIndex = srcFamily;
+	barrier.dstQueueFamilyIndex = dstFamily;
+	barrier.buffer = buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(commandBuffer, srcStage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void RecordBufferAcquire(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t srcFamily, uint32_t dstFamily,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	if (srcFamily == dstFamily)
+		return;
+
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = 0; // Ignored for an acquire
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex = srcFamily;
+	barrier.dstQueueFamilyIndex = dstFamily;
+	barrier.buffer = buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	// Chains with the semaphore wait, which has to use dstStage as well.
+	vkCmdPipelineBarrier(commandBuffer, dstStage, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void RecordImageRelease(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range,
+	VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t srcFamily, uint32_t dstFamily,
+	VkPipelineStageFlags srcStage, VkAccessFlags srcAccess)
+{
+	// Within one family the acquire side does the layout transition on its own.
+	if (srcFamily == dstFamily)
+		return;
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = 0; // Ignored for a release
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = srcFamily;
+	barrier.dstQueueFamilyIndex = dstFamily;
+	barrier.image = image;
+	barrier.subresourceRange = range;
+
+	vkCmdPipelineBarrier(commandBuffer, srcStage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void RecordImageAcquire(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range,
+	VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t srcFamily, uint32_t dstFamily,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	if (srcFamily == dstFamily && oldLayout == newLayout)
+		return;
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = 0; // Made available by the semaphore
+	barrier.dstAccessMask = dstAccess;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = srcFamily == dstFamily ? VK_QUEUE_FAMILY_IGNORED : srcFamily;
+	barrier.dstQueueFamilyIndex = srcFamily == dstFamily ? VK_QUEUE_FAMILY_IGNORED : dstFamily;
+	barrier.image = image;
+	barrier.subresourceRange = range;
+
+	// Chains with the semaphore wait, which has to use dstStage as well.
+	vkCmdPipelineBarrier(commandBuffer, dstStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+// Queue family ownership transfers for resources created with VK_SHARING_MODE_EXCLUSIVE.
+// Record the release on the source queue and the matching acquire on the destination queue, and make the destination
+// submission wait for the source submission (e.g. on its timeline value) at dstStage.
+// Between queues of the same family no transfer is needed: the release records nothing and the acquire only
+// transitions the image layout if it changes.
+
+void RecordBufferRelease(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t srcFamily, uint32_t dstFamily,
+	VkPipelineStageFlags srcStage, VkAccessFlags srcAccess);
+void RecordBufferAcquire(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t srcFamily, uint32_t dstFamily,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+void RecordImageRelease(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range,
+	VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t srcFamily, uint32_t dstFamily,
+	VkPipelineStageFlags srcStage, VkAccessFlags srcAccess);
+void RecordImageAcquire(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range,
+	VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t srcFamily, uint32_t dstFamily,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
@@ -0,0 +1,80 @@
+#include "CommandAllocator.h"
+
+#include <stdexcept>
+#include <utility>
+
+CommandAllocator::CommandAllocator(CommandAllocator&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+CommandAllocator& CommandAllocator::operator=(CommandAllocator&& other) noexcept
+{
+	// The target must not own a pool yet, it would be leaked.
+	m_HostAllocator = std::exchange(other.m_HostAllocator, nullptr);
+	m_Device = std::exchange(other.m_Device, VK_NULL_HANDLE);
+	m_Pool = std::exchange(other.m_Pool, VK_NULL_HANDLE);
+	m_Primary = std::exchange(other.m_Primary, {});
+	m_Secondary = std::exchange(other.m_Secondary, {});
+	m_AllocationsSinceReset = std::exchange(other.m_AllocationsSinceReset, 0);
+	m_TotalAllocations = std::exchange(other.m_TotalAllocations, 0);
+	return *this;
+}
+
+void CommandAllocator::Create(HostAllocator* hostAllocator, VkDevice device, uint32_t queueFamilyIndex)
+{
+	m_HostAllocator = hostAllocator;
+	m_Device = device;
+
+	// No RESET_COMMAND_BUFFER_BIT, individually resettable buffers keep many drivers off their fast linear allocator.
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+	if (vkCreateCommandPool(m_Device, &poolInfo, m_HostAllocator->Get(VK_OBJECT_TYPE_COMMAND_POOL), &m_Pool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create command pool!");
+}
+
+void CommandAllocator::Destroy()
+{
+	// Destroying the pool frees all of its command buffers.
+	vkDestroyCommandPool(m_Device, m_Pool, m_HostAllocator->Get(VK_OBJECT_TYPE_COMMAND_POOL));
+	m_Pool = VK_NULL_HANDLE;
+	m_Primary = {};
+	m_Secondary = {};
+}
+
+void CommandAllocator::Reset()
+{
+	if (vkResetCommandPool(m_Device, m_Pool, 0) != VK_SUCCESS)
+		throw std::runtime_error("Failed to reset command pool!");
+
+	m_Primary.used = 0;
+	m_Secondary.used = 0;
+	m_AllocationsSinceReset = 0;
+}
+
+VkCommandBuffer CommandAllocator::Allocate(VkCommandBufferLevel level)
+{
+	CommandBufferList& list = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY ? m_Primary : m_Secondary;
+
+	if (list.used == list.buffers.size())
+	{
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = m_Pool;
+		allocInfo.level = level;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(m_Device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+			throw std::runtime_error("Failed to allocate command buffers!");
+
+		list.buffers.push_back(commandBuffer);
+		m_AllocationsSinceReset++;
+		m_TotalAllocations++;
+	}
+
+	return list.buffers[list.used++];
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "HostAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// Hands out command buffers from a single pool that is reset as a whole, instead of resetting buffers one by one.
+// Buffers are recycled after every Reset(), so a steady frame loop never asks the driver for new ones.
+// Like the pool itself, an allocator must only be used by one thread at a time. Move-only, so a pool always has a
+// single owner that resets and destroys it.
+class CommandAllocator
+{
+public:
+	CommandAllocator() = default;
+	CommandAllocator(const CommandAllocator&) = delete;
+	CommandAllocator& operator=(const CommandAllocator&) = delete;
+	CommandAllocator(CommandAllocator&& other) noexcept;
+	CommandAllocator& operator=(CommandAllocator&& other) noexcept;
+
+	void Create(HostAllocator* hostAllocator, VkDevice device, uint32_t queueFamilyIndex);
+	void Destroy();
+
+	// Recycles every command buffer handed out since the last reset. The GPU must be done with all of them.
+	void Reset();
+	VkCommandBuffer Allocate(VkCommandBufferLevel level);
+
+	// Command buffers the driver had to create since the last Reset(), should be 0 once the frame loop has warmed up.
+	uint32_t GetAllocationsSinceReset() const { return m_AllocationsSinceReset; }
+	uint64_t GetTotalAllocations() const { return m_TotalAllocations; }
+private:
+	struct CommandBufferList
+	{
+		std::vector<VkCommandBuffer> buffers;
+		size_t used = 0;
+	};
+private:
+	HostAllocator* m_HostAllocator = nullptr;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkCommandPool m_Pool = VK_NULL_HANDLE;
+	CommandBufferList m_Primary, m_Secondary;
+	uint32_t m_AllocationsSinceReset = 0;
+	uint64_t m_TotalAllocations = 0;
+};
@@ -0,0 +1,229 @@
+#include "Defragmenter.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// Upper bound for the copies started in one step, the GPU time they take isn't part of the CPU time budget.
+static constexpr VkDeviceSize s_MaxBytesPerStep = 16 * 1024 * 1024;
+
+void Defragmenter::Create(DeviceAllocator* allocator, HostAllocator* hostAllocator, VkDevice device, VkQueue queue, uint32_t queueFamilyIndex,
+	uint32_t graphicsFamilyIndex, SubmitBatcher* batcher, Timeline* graphicsTimeline, DeletionQueue* deletionQueue)
+{
+	m_Allocator = allocator;
+	m_HostAllocator = hostAllocator;
+	m_Device = device;
+	m_Queue = queue;
+	m_QueueFamilyIndex = queueFamilyIndex;
+	m_GraphicsFamilyIndex = graphicsFamilyIndex;
+	m_Batcher = batcher;
+	m_GraphicsTimeline = graphicsTimeline;
+	m_DeletionQueue = deletionQueue;
+
+	m_Timeline.Create(m_HostAllocator, m_Device);
+}
+
+void Defragmenter::Destroy()
+{
+	m_Timeline.Wait(m_Timeline.GetLastSubmitted());
+
+	// Moves that never completed still own their new buffer, the owners keep the old one.
+	for (auto& batch : m_InFlight)
+	{
+		for (auto& move : batch.moves)
+			FreeBuffer(move.buffer, move.allocation);
+		batch.commandAllocator.Destroy();
+	}
+	m_InFlight.clear();
+
+	for (auto& allocator : m_FreeAllocators)
+		allocator.Destroy();
+	m_FreeAllocators.clear();
+
+	m_Movables.clear();
+	m_Timeline.Destroy();
+}
+
+Defragmenter::MovableId Defragmenter::RegisterBuffer(VkBuffer buffer, Allocation* allocation, const VkBufferCreateInfo& createInfo,
+	std::function<void(VkBuffer buffer, Allocation* allocation)> rebind)
+{
+	const VkBufferUsageFlags requiredUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	if ((createInfo.usage & requiredUsage) != requiredUsage)
+		throw std::runtime_error("Movable buffers need transfer source and destination usage!");
+
+	// Copies skip ownership transfers, an exclusive buffer would belong to the wrong family on either side of a move.
+	if (m_QueueFamilyIndex != m_GraphicsFamilyIndex)
+	{
+		auto sharedWith = [&createInfo](uint32_t family) {
+			return createInfo.sharingMode == VK_SHARING_MODE_CONCURRENT &&
+				std::find(createInfo.pQueueFamilyIndices, createInfo.pQueueFamilyIndices + createInfo.queueFamilyIndexCount, family) !=
+				createInfo.pQueueFamilyIndices + createInfo.queueFamilyIndexCount;
+		};
+		if (!sharedWith(m_QueueFamilyIndex) || !sharedWith(m_GraphicsFamilyIndex))
+			throw std::runtime_error("Movable buffers must be shared concurrently by the transfer and graphics families!");
+	}
+
+	MovableId id = m_NextId++;
+	Movable& movable = m_Movables[id];
+	movable.buffer = buffer;
+	movable.allocation = allocation;
+	movable.createInfo = createInfo;
+	movable.rebind = std::move(rebind);
+
+	// The create info is reused for every move, so it can't point into the caller's memory.
+	movable.createInfo.pNext = nullptr;
+	if (createInfo.sharingMode == VK_SHARING_MODE_CONCURRENT)
+		movable.queueFamilyIndices.assign(createInfo.pQueueFamilyIndices, createInfo.pQueueFamilyIndices + createInfo.queueFamilyIndexCount);
+	movable.createInfo.pQueueFamilyIndices = movable.queueFamilyIndices.data();
+
+	return id;
+}
+
+void Defragmenter::UnregisterBuffer(MovableId id)
+{
+	m_Movables.erase(id);
+}
+
+std::optional<TimelineWait> Defragmenter::Step(std::chrono::microseconds timeBudget)
+{
+	auto deadline = std::chrono::steady_clock::now() + timeBudget;
+
+	m_Stats.bytesMoved = 0;
+
+	uint64_t completedValue = CompleteMoves();
+	StartMoves(deadline);
+
+	if (completedValue == 0)
+		return std::nullopt;
+
+	// Movable buffers may be read by any stage, the copies are done so waiting at all of them costs nothing.
+	return m_Timeline.WaitFor(completedValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+}
+
+uint64_t Defragmenter::CompleteMoves()
+{
+	uint64_t completedValue = 0;
+	while (!m_InFlight.empty() && m_Timeline.HasPassed(m_InFlight.front().submittedValue))
+	{
+		Batch& batch = m_InFlight.front();
+		for (const auto& move : batch.moves)
+		{
+			auto it = m_Movables.find(move.id);
+			if (it == m_Movables.end())
+			{
+				// Unregistered while moving, nothing ever used the copy.
+				FreeBuffer(move.buffer, move.allocation);
+				continue;
+			}
+
+			// Frames recorded from now on use the new buffer, the ones already submitted may still read the old one.
+			Movable& movable = it->second;
+			m_DeletionQueue->Push(m_GraphicsTimeline->GetLastReserved(), [this, buffer = movable.buffer, allocation = movable.allocation]() {
+				// The allocator gives a block back as soon as its last allocation is freed.
+				uint32_t blocksBefore = m_Allocator->GetStats().blockCount;
+				FreeBuffer(buffer, allocation);
+				if (m_Allocator->GetStats().blockCount < blocksBefore)
+					m_Stats.totalBlocksReleased++;
+			});
+			movable.buffer = move.buffer;
+			movable.allocation = move.allocation;
+			movable.moving = false;
+			movable.rebind(move.buffer, move.allocation);
+
+			m_Stats.bytesMoved += move.size;
+			m_Stats.totalBytesMoved += move.size;
+			m_Stats.totalMoves++;
+		}
+
+		m_Stats.movesInFlight -= static_cast<uint32_t>(batch.moves.size());
+		completedValue = batch.submittedValue;
+		batch.commandAllocator.Reset();
+		m_FreeAllocators.push_back(std::move(batch.commandAllocator));
+		m_InFlight.pop_front();
+	}
+
+	return completedValue;
+}
+
+void Defragmenter::StartMoves(std::chrono::steady_clock::time_point deadline)
+{
+	std::vector<const DeviceAllocatorBlock*> sparseBlocks = m_Allocator->GetSparseBlocks();
+	if (sparseBlocks.empty())
+		return;
+
+	Batch batch;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	VkDeviceSize bytes = 0;
+
+	for (auto& [id, movable] : m_Movables)
+	{
+		if (std::chrono::steady_clock::now() >= deadline || bytes >= s_MaxBytesPerStep)
+			break;
+
+		if (movable.moving || std::find(sparseBlocks.begin(), sparseBlocks.end(), movable.allocation->block) == sparseBlocks.end())
+			continue;
+
+		VkBuffer buffer;
+		if (vkCreateBuffer(m_Device, &movable.createInfo, m_HostAllocator->Get(VK_OBJECT_TYPE_BUFFER), &buffer) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create buffer!");
+
+		Allocation* allocation = m_Allocator->AllocateBufferForMove(buffer, movable.allocation);
+		if (allocation == nullptr)
+		{
+			// The other blocks are full, moving anything else out of this pool won't fit either.
+			vkDestroyBuffer(m_Device, buffer, m_HostAllocator->Get(VK_OBJECT_TYPE_BUFFER));
+			continue;
+		}
+
+		if (commandBuffer == VK_NULL_HANDLE)
+		{
+			if (!m_FreeAllocators.empty())
+			{
+				batch.commandAllocator = std::move(m_FreeAllocators.back());
+				m_FreeAllocators.pop_back();
+			}
+			else
+				batch.commandAllocator.Create(m_HostAllocator, m_Device, m_QueueFamilyIndex);
+
+			commandBuffer = batch.commandAllocator.Allocate(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+			if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+				throw std::runtime_error("Failed to begin recording defragmentation command buffer!");
+		}
+
+		VkBufferCopy region{};
+		region.srcOffset = 0;
+		region.dstOffset = 0;
+		region.size = movable.createInfo.size;
+		vkCmdCopyBuffer(commandBuffer, movable.buffer, buffer, 1, &region);
+
+		movable.moving = true;
+		batch.moves.push_back({ id, buffer, allocation, movable.createInfo.size });
+		bytes += movable.createInfo.size;
+	}
+
+	if (commandBuffer == VK_NULL_HANDLE)
+		return;
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to record defragmentation command buffer!");
+
+	// Waiting for the graphics work recorded so far covers any write that came before registration.
+	batch.submittedValue = m_Timeline.Next();
+	VkSemaphoreSubmitInfo waitInfo = SubmitBatcher::SemaphoreInfo(
+		m_GraphicsTimeline->WaitFor(m_GraphicsTimeline->GetLastReserved(), VK_PIPELINE_STAGE_2_TRANSFER_BIT));
+	VkSemaphoreSubmitInfo signalInfo = SubmitBatcher::SemaphoreInfo(m_Timeline.GetSemaphore(), batch.submittedValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+	m_Batcher->Add(m_Queue, { &commandBuffer, 1 }, { &waitInfo, 1 }, { &signalInfo, 1 }, &m_Timeline);
+
+	m_Stats.movesInFlight += static_cast<uint32_t>(batch.moves.size());
+	m_InFlight.push_back(std::move(batch));
+}
+
+void Defragmenter::FreeBuffer(VkBuffer buffer, Allocation* allocation)
+{
+	vkDestroyBuffer(m_Device, buffer, m_HostAllocator->Get(VK_OBJECT_TYPE_BUFFER));
+	m_Allocator->Free(allocation);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "CommandAllocator.h"
+#include "DeletionQueue.h"
+#include "DeviceAllocator.h"
+#include "HostAllocator.h"
+#include "SubmitBatcher.h"
+#include "Timeline.h"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+struct DefragmentationStats
+{
+	// During the last Step().
+	VkDeviceSize bytesMoved = 0;
+	// Since Create(). Blocks are counted once the deletion queue has freed the buffers moved out of them.
+	uint64_t totalBytesMoved = 0;
+	uint32_t totalMoves = 0;
+	uint32_t totalBlocksReleased = 0;
+	uint32_t movesInFlight = 0;
+};
+
+// Moves buffers out of the sparsest block of each memory pool with copies on the transfer queue, a few per frame, so
+// long sessions that stream content in and out give emptied blocks back to the driver.
+// Once a copy is done the owner gets the new buffer through its rebind callback, and the old one goes to the deletion
+// queue, keyed by the last graphics submission recorded before the rebind. Movable buffers must not be written by the GPU
+// after registration, and they are copied on the transfer queue without an ownership transfer: when the transfer and
+// graphics families differ they have to be created with VK_SHARING_MODE_CONCURRENT across both.
+// Images aren't moved, their layouts and views would have to move with them.
+// Render thread only.
+class Defragmenter
+{
+public:
+	using MovableId = uint64_t;
+
+	// Movable buffers must be created with hostAllocator's callbacks for VK_OBJECT_TYPE_BUFFER, moves replace and
+	// destroy them.
+	void Create(DeviceAllocator* allocator, HostAllocator* hostAllocator, VkDevice device, VkQueue queue, uint32_t queueFamilyIndex,
+		uint32_t graphicsFamilyIndex, SubmitBatcher* batcher, Timeline* graphicsTimeline, DeletionQueue* deletionQueue);
+	// Run the deletion queue's remaining destructions first.
+	void Destroy();
+
+	// createInfo must be the one buffer was created with and include VK_BUFFER_USAGE_TRANSFER_SRC_BIT and _DST_BIT.
+	// Throws if the buffer isn't shared concurrently with both families while they differ.
+	MovableId RegisterBuffer(VkBuffer buffer, Allocation* allocation, const VkBufferCreateInfo& createInfo,
+		std::function<void(VkBuffer buffer, Allocation* allocation)> rebind);
+	// The owner keeps destroying its current buffer. A move in flight is dropped.
+	void UnregisterBuffer(MovableId id);
+
+	// Completes finished moves and starts new ones until timeBudget is spent. Call once per frame, before recording.
+	// If owners were rebound, the returned wait has to be added to the frame's graphics submission: the host has seen
+	// the copies finish, but only a semaphore wait makes the transfer queue's writes visible to graphics reads.
+	std::optional<TimelineWait> Step(std::chrono::microseconds timeBudget);
+
+	const DefragmentationStats& GetStats() const { return m_Stats; }
+private:
+	struct Movable
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		Allocation* allocation = nullptr;
+		VkBufferCreateInfo createInfo{};
+		std::vector<uint32_t> queueFamilyIndices;
+		std::function<void(VkBuffer, Allocation*)> rebind;
+		bool moving = false;
+	};
+
+	struct Move
+	{
+		MovableId id;
+		VkBuffer buffer;
+		Allocation* allocation;
+		VkDeviceSize size;
+	};
+
+	struct Batch
+	{
+		std::vector<Move> moves;
+		CommandAllocator commandAllocator;
+		uint64_t submittedValue = 0;
+	};
+
+private:
+	// Returns the value of the last batch it completed, 0 if none.
+	uint64_t CompleteMoves();
+	void StartMoves(std::chrono::steady_clock::time_point deadline);
+	void FreeBuffer(VkBuffer buffer, Allocation* allocation);
+private:
+	DeviceAllocator* m_Allocator = nullptr;
+	HostAllocator* m_HostAllocator = nullptr;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkQueue m_Queue = VK_NULL_HANDLE;
+	uint32_t m_QueueFamilyIndex = 0;
+	uint32_t m_GraphicsFamilyIndex = 0;
+	SubmitBatcher* m_Batcher = nullptr;
+	Timeline* m_GraphicsTimeline = nullptr;
+	DeletionQueue* m_DeletionQueue = nullptr;
+	Timeline m_Timeline;
+	std::unordered_map<MovableId, Movable> m_Movables;
+	MovableId m_NextId = 1;
+	std::deque<Batch> m_InFlight;
+	std::vector<CommandAllocator> m_FreeAllocators;
+	DefragmentationStats m_Stats;
+};
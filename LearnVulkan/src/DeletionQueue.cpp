@@ -0,0 +1,45 @@
+#include "DeletionQueue.h"
+
+#include <algorithm>
+
+void DeletionQueue::Create(Timeline* timeline)
+{
+	m_Timeline = timeline;
+}
+
+void DeletionQueue::Destroy()
+{
+	if (!m_Entries.empty())
+		m_Timeline->Wait(m_Timeline->GetLastSubmitted());
+
+	// A destruction may queue further ones, e.g. an owner releasing what it referenced.
+	while (!m_Entries.empty())
+	{
+		Entry entry = std::move(m_Entries.front());
+		m_Entries.pop_front();
+		entry.destroy();
+	}
+}
+
+void DeletionQueue::Push(uint64_t value, std::function<void()> destroy)
+{
+	// Kept sorted, so Collect() can stop at the first value the GPU hasn't reached. Values almost always come in order.
+	auto position = std::upper_bound(m_Entries.begin(), m_Entries.end(), value, [](uint64_t value, const Entry& entry) {
+		return value < entry.value;
+	});
+	m_Entries.insert(position, { value, std::move(destroy) });
+}
+
+uint32_t DeletionQueue::Collect()
+{
+	uint32_t count = 0;
+	while (!m_Entries.empty() && m_Timeline->HasPassed(m_Entries.front().value))
+	{
+		Entry entry = std::move(m_Entries.front());
+		m_Entries.pop_front();
+		entry.destroy();
+		count++;
+	}
+
+	return count;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Timeline.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// Destroys resources once the GPU is done with them, so replacing one at runtime (swap chain resize, eviction,
+// defragmentation, pipeline reload) never has to wait for the device to go idle.
+// Each destruction is queued with the timeline value of the last submission that may use the resource, usually
+// GetLastReserved() right when nothing recorded from then on references it any more. Collect() runs the ones the
+// GPU has passed, in queue order. Render thread only.
+class DeletionQueue
+{
+public:
+	void Create(Timeline* timeline);
+	// Waits for the GPU and runs everything still queued.
+	void Destroy();
+
+	void Push(uint64_t value, std::function<void()> destroy);
+	// Keyed by the timeline's last reserved value, which covers work recorded but not flushed yet.
+	void Push(std::function<void()> destroy) { Push(m_Timeline->GetLastReserved(), std::move(destroy)); }
+
+	// Returns the number of destructions run. Call once per frame.
+	uint32_t Collect();
+
+	size_t GetPendingCount() const { return m_Entries.size(); }
+private:
+	struct Entry
+	{
+		uint64_t value;
+		std::function<void()> destroy;
+	};
+private:
+	Timeline* m_Timeline = nullptr;
+	std::deque<Entry> m_Entries;
+};
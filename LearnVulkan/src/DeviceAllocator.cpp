@@ -0,0 +1,466 @@
+#include "DeviceAllocator.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+// Smallest range a block hands out, and the block size on heaps large enough for it.
+static constexpr VkDeviceSize s_MinAllocationSize = 256;
+static constexpr VkDeviceSize s_DefaultBlockSize = 64ull * 1024 * 1024;
+
+void DeviceAllocator::Create(HostAllocator* hostAllocator, VkPhysicalDevice physicalDevice, VkDevice device)
+{
+	m_HostAllocator = hostAllocator;
+	m_Device = device;
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_MemoryProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	m_MaxDeviceMemoryCount = properties.limits.maxMemoryAllocationCount;
+
+	m_Pools.resize(m_MemoryProperties.memoryTypeCount * 2);
+	for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; i++)
+	{
+		// Small heaps (e.g. the 256MB host visible device local one) get smaller blocks, so one block can't take all of it.
+		VkDeviceSize heapSize = m_MemoryProperties.memoryHeaps[m_MemoryProperties.memoryTypes[i].heapIndex].size;
+		VkDeviceSize blockSize = std::max(std::min(s_DefaultBlockSize, std::bit_floor(heapSize / 8)), s_MinAllocationSize);
+
+		for (uint32_t linear = 0; linear < 2; linear++)
+		{
+			Pool& pool = m_Pools[i * 2 + linear];
+			pool.blockSize = blockSize;
+			pool.orderCount = static_cast<uint32_t>(std::countr_zero(blockSize / s_MinAllocationSize)) + 1;
+		}
+	}
+}
+
+void DeviceAllocator::Destroy()
+{
+	std::lock_guard lock(m_Mutex);
+
+	for (auto& pool : m_Pools)
+		for (auto& block : pool.blocks)
+			vkFreeMemory(m_Device, block->memory, m_HostAllocator->Get(VK_OBJECT_TYPE_DEVICE_MEMORY));
+	m_Pools.clear();
+
+	for (Allocation* allocation : m_Dedicated)
+	{
+		vkFreeMemory(m_Device, allocation->memory, m_HostAllocator->Get(VK_OBJECT_TYPE_DEVICE_MEMORY));
+		delete allocation;
+	}
+	m_Dedicated.clear();
+
+	m_DeviceMemoryCount = 0;
+	m_HeapUsage.fill(0);
+	m_AllocationCount = 0;
+	m_RequestedBytes = 0;
+}
+
+Allocation* DeviceAllocator::AllocateBuffer(VkBuffer buffer, MemoryUsage usage)
+{
+	VkBufferMemoryRequirementsInfo2 requirementsInfo{};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+	requirementsInfo.buffer = buffer;
+
+	VkMemoryDedicatedRequirements dedicatedRequirements{};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+	VkMemoryRequirements2 requirements{};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	requirements.pNext = &dedicatedRequirements;
+	vkGetBufferMemoryRequirements2(m_Device, &requirementsInfo, &requirements);
+
+	bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+	Allocation* allocation = Allocate(requirements.memoryRequirements, dedicated, true, usage, buffer, VK_NULL_HANDLE);
+
+	if (vkBindBufferMemory(m_Device, buffer, allocation->memory, allocation->offset) != VK_SUCCESS)
+	{
+		Free(allocation);
+		throw std::runtime_error("Failed to bind buffer memory!");
+	}
+
+	return allocation;
+}
+
+Allocation* DeviceAllocator::AllocateImage(VkImage image, VkImageTiling tiling, MemoryUsage usage)
+{
+	VkImageMemoryRequirementsInfo2 requirementsInfo{};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+	requirementsInfo.image = image;
+
+	VkMemoryDedicatedRequirements dedicatedRequirements{};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+	VkMemoryRequirements2 requirements{};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	requirements.pNext = &dedicatedRequirements;
+	vkGetImageMemoryRequirements2(m_Device, &requirementsInfo, &requirements);
+
+	bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+	Allocation* allocation = Allocate(requirements.memoryRequirements, dedicated, tiling == VK_IMAGE_TILING_LINEAR, usage, VK_NULL_HANDLE, image);
+
+	if (vkBindImageMemory(m_Device, image, allocation->memory, allocation->offset) != VK_SUCCESS)
+	{
+		Free(allocation);
+		throw std::runtime_error("Failed to bind image memory!");
+	}
+
+	return allocation;
+}
+
+Allocation* DeviceAllocator::AllocateMemory(const VkMemoryRequirements& requirements, MemoryUsage usage)
+{
+	return Allocate(requirements, false, false, usage, VK_NULL_HANDLE, VK_NULL_HANDLE);
+}
+
+Allocation* DeviceAllocator::Allocate(const VkMemoryRequirements& requirements, bool dedicated, bool linear, MemoryUsage usage,
+	VkBuffer buffer, VkImage image)
+{
+	VkMemoryPropertyFlags required = 0, preferred = 0;
+	switch (usage)
+	{
+	case MemoryUsage::GpuOnly:
+		preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		break;
+	case MemoryUsage::CpuToGpu:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		break;
+	case MemoryUsage::GpuToCpu:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+		break;
+	case MemoryUsage::GpuLazy:
+		preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+		break;
+	}
+
+	uint32_t memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, required, preferred);
+	if (memoryTypeIndex == UINT32_MAX)
+		throw std::runtime_error("Failed to find suitable memory type!");
+
+	if (usage == MemoryUsage::GpuLazy)
+	{
+		// Desktop GPUs have no lazily allocated memory, the attachment then takes regular device local memory.
+		if (m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+			dedicated = true;
+		else
+			memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+
+	std::lock_guard lock(m_Mutex);
+
+	Pool& pool = m_Pools[memoryTypeIndex * 2 + (linear ? 1 : 0)];
+	// Buddy ranges are aligned to their own size, so rounding up to the alignment is all it takes.
+	VkDeviceSize size = std::max({ requirements.size, requirements.alignment, s_MinAllocationSize });
+	if (dedicated || size > pool.blockSize / 2)
+		return AllocateDedicated(requirements, memoryTypeIndex, buffer, image);
+
+	Allocation* allocation = AllocateFromPool(pool, memoryTypeIndex, std::bit_ceil(size));
+	allocation->size = requirements.size;
+	m_RequestedBytes += requirements.size;
+	m_AllocationCount++;
+	return allocation;
+}
+
+Allocation* DeviceAllocator::AllocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, VkBuffer buffer, VkImage image)
+{
+	VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+	dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+	dedicatedInfo.buffer = buffer;
+	dedicatedInfo.image = image;
+
+	Allocation* allocation = new Allocation();
+	allocation->memory = AllocateDeviceMemory(requirements.size, memoryTypeIndex, &dedicatedInfo, &allocation->mapped);
+	allocation->offset = 0;
+	allocation->size = requirements.size;
+	allocation->memoryTypeIndex = memoryTypeIndex;
+	m_Dedicated.insert(allocation);
+
+	m_RequestedBytes += requirements.size;
+	m_AllocationCount++;
+	return allocation;
+}
+
+Allocation* DeviceAllocator::AllocateFromPool(Pool& pool, uint32_t memoryTypeIndex, VkDeviceSize size, const DeviceAllocatorBlock* excludedBlock)
+{
+	uint32_t order = static_cast<uint32_t>(std::countr_zero(size / s_MinAllocationSize));
+
+	DeviceAllocatorBlock* block = nullptr;
+	uint32_t freeOrder = 0;
+	for (auto& candidate : pool.blocks)
+	{
+		if (candidate.get() == excludedBlock)
+			continue;
+
+		uint32_t candidateOrder = order;
+		for (; candidateOrder < pool.orderCount; candidateOrder++)
+			if (!candidate->freeLists[candidateOrder].empty())
+				break;
+
+		if (candidateOrder == pool.orderCount)
+			continue;
+
+		// Moves go to the fullest block with room, everything else to the first one.
+		if (block == nullptr || (excludedBlock != nullptr && candidate->usedBytes > block->usedBytes))
+		{
+			block = candidate.get();
+			freeOrder = candidateOrder;
+		}
+
+		if (excludedBlock == nullptr)
+			break;
+	}
+
+	// Moving into a new block wouldn't free anything.
+	if (block == nullptr && excludedBlock != nullptr)
+		return nullptr;
+
+	if (block == nullptr)
+	{
+		auto newBlock = std::make_unique<DeviceAllocatorBlock>();
+		newBlock->memory = AllocateDeviceMemory(pool.blockSize, memoryTypeIndex, nullptr, &newBlock->mapped);
+		newBlock->memoryTypeIndex = memoryTypeIndex;
+		newBlock->poolIndex = static_cast<uint32_t>(&pool - m_Pools.data());
+		newBlock->freeLists.resize(pool.orderCount);
+		newBlock->freeLists[pool.orderCount - 1].insert(0);
+
+		block = newBlock.get();
+		freeOrder = pool.orderCount - 1;
+		pool.blocks.push_back(std::move(newBlock));
+	}
+
+	// Take the smallest free range that fits and split it down, returning the upper halves to the free lists.
+	VkDeviceSize offset = *block->freeLists[freeOrder].begin();
+	block->freeLists[freeOrder].erase(offset);
+	while (freeOrder > order)
+	{
+		freeOrder--;
+		block->freeLists[freeOrder].insert(offset + (s_MinAllocationSize << freeOrder));
+	}
+
+	block->usedBytes += size;
+	block->allocationCount++;
+
+	Allocation* allocation = new Allocation();
+	allocation->memory = block->memory;
+	allocation->offset = offset;
+	allocation->memoryTypeIndex = memoryTypeIndex;
+	allocation->mapped = block->mapped ? static_cast<char*>(block->mapped) + offset : nullptr;
+	allocation->block = block;
+	allocation->order = order;
+	return allocation;
+}
+
+Allocation* DeviceAllocator::AllocateBufferForMove(VkBuffer buffer, const Allocation* current)
+{
+	if (current->block == nullptr)
+		return nullptr;
+
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(m_Device, buffer, &requirements);
+	if (!(requirements.memoryTypeBits & (1 << current->memoryTypeIndex)))
+		return nullptr;
+
+	Allocation* allocation = nullptr;
+	{
+		std::lock_guard lock(m_Mutex);
+
+		Pool& pool = m_Pools[current->block->poolIndex];
+		VkDeviceSize size = std::max({ requirements.size, requirements.alignment, s_MinAllocationSize });
+		allocation = AllocateFromPool(pool, current->memoryTypeIndex, std::bit_ceil(size), current->block);
+		if (allocation == nullptr)
+			return nullptr;
+
+		allocation->size = requirements.size;
+		m_RequestedBytes += requirements.size;
+		m_AllocationCount++;
+	}
+
+	if (vkBindBufferMemory(m_Device, buffer, allocation->memory, allocation->offset) != VK_SUCCESS)
+	{
+		Free(allocation);
+		throw std::runtime_error("Failed to bind buffer memory!");
+	}
+
+	return allocation;
+}
+
+std::vector<const DeviceAllocatorBlock*> DeviceAllocator::GetSparseBlocks()
+{
+	std::lock_guard lock(m_Mutex);
+
+	std::vector<const DeviceAllocatorBlock*> sparseBlocks;
+	for (const auto& pool : m_Pools)
+	{
+		if (pool.blocks.size() < 2)
+			continue;
+
+		auto sparsest = std::min_element(pool.blocks.begin(), pool.blocks.end(), [](const auto& a, const auto& b) {
+			return a->usedBytes < b->usedBytes;
+		});
+		if ((*sparsest)->usedBytes <= pool.blockSize / 2)
+			sparseBlocks.push_back(sparsest->get());
+	}
+
+	return sparseBlocks;
+}
+
+void DeviceAllocator::Free(Allocation* allocation)
+{
+	if (allocation == nullptr)
+		return;
+
+	std::lock_guard lock(m_Mutex);
+
+	m_RequestedBytes -= allocation->size;
+	m_AllocationCount--;
+
+	if (allocation->block == nullptr)
+	{
+		FreeDeviceMemory(allocation->memory, allocation->size, allocation->memoryTypeIndex);
+		m_Dedicated.erase(allocation);
+		delete allocation;
+		return;
+	}
+
+	DeviceAllocatorBlock& block = *allocation->block;
+	FreeBlockRange(block, allocation->offset, allocation->order);
+	delete allocation;
+
+	// Keep one empty block per pool around, so a single resource coming and going doesn't reallocate every time.
+	Pool& pool = m_Pools[block.poolIndex];
+	if (block.allocationCount == 0 && pool.blocks.size() > 1)
+	{
+		FreeDeviceMemory(block.memory, pool.blockSize, block.memoryTypeIndex);
+		pool.blocks.erase(std::find_if(pool.blocks.begin(), pool.blocks.end(), [&block](const auto& candidate) {
+			return candidate.get() == &block;
+		}));
+	}
+}
+
+void DeviceAllocator::FreeBlockRange(DeviceAllocatorBlock& block, VkDeviceSize offset, uint32_t order)
+{
+	block.usedBytes -= s_MinAllocationSize << order;
+	block.allocationCount--;
+
+	// Merge with the buddy as long as it is free as well.
+	uint32_t maxOrder = static_cast<uint32_t>(block.freeLists.size()) - 1;
+	while (order < maxOrder)
+	{
+		VkDeviceSize buddy = offset ^ (s_MinAllocationSize << order);
+		if (block.freeLists[order].erase(buddy) == 0)
+			break;
+
+		offset = std::min(offset, buddy);
+		order++;
+	}
+
+	block.freeLists[order].insert(offset);
+}
+
+VkDeviceMemory DeviceAllocator::AllocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, const void* pNext, void** mapped)
+{
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext = pNext;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(m_Device, &allocInfo, m_HostAllocator->Get(VK_OBJECT_TYPE_DEVICE_MEMORY), &memory) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate device memory!");
+
+	// Host visible memory stays mapped for its whole lifetime, mapping is not free and may not be done twice.
+	*mapped = nullptr;
+	if (IsHostVisible(memoryTypeIndex) && vkMapMemory(m_Device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+	{
+		vkFreeMemory(m_Device, memory, m_HostAllocator->Get(VK_OBJECT_TYPE_DEVICE_MEMORY));
+		throw std::runtime_error("Failed to map device memory!");
+	}
+
+	m_DeviceMemoryCount++;
+	m_HeapUsage[m_MemoryProperties.memoryTypes[memoryTypeIndex].heapIndex] += size;
+	return memory;
+}
+
+void DeviceAllocator::FreeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryTypeIndex)
+{
+	vkFreeMemory(m_Device, memory, m_HostAllocator->Get(VK_OBJECT_TYPE_DEVICE_MEMORY));
+	m_DeviceMemoryCount--;
+	m_HeapUsage[m_MemoryProperties.memoryTypes[memoryTypeIndex].heapIndex] -= size;
+}
+
+VkDeviceSize DeviceAllocator::GetHeapUsage(uint32_t heapIndex)
+{
+	std::lock_guard lock(m_Mutex);
+	return m_HeapUsage[heapIndex];
+}
+
+DeviceAllocatorStats DeviceAllocator::GetStats()
+{
+	std::lock_guard lock(m_Mutex);
+
+	DeviceAllocatorStats stats;
+	stats.deviceMemoryCount = m_DeviceMemoryCount;
+	stats.maxDeviceMemoryCount = m_MaxDeviceMemoryCount;
+	stats.dedicatedCount = static_cast<uint32_t>(m_Dedicated.size());
+	stats.allocationCount = m_AllocationCount;
+	stats.requestedBytes = m_RequestedBytes;
+
+	VkDeviceSize freeBytes = 0, largestFreeRange = 0;
+	for (const auto& pool : m_Pools)
+	{
+		for (const auto& block : pool.blocks)
+		{
+			stats.blockCount++;
+			stats.reservedBytes += pool.blockSize;
+			stats.usedBytes += block->usedBytes;
+			freeBytes += pool.blockSize - block->usedBytes;
+
+			for (uint32_t order = pool.orderCount; order-- > 0;)
+			{
+				if (!block->freeLists[order].empty())
+				{
+					largestFreeRange = std::max(largestFreeRange, s_MinAllocationSize << order);
+					break;
+				}
+			}
+		}
+	}
+
+	for (const Allocation* allocation : m_Dedicated)
+	{
+		stats.reservedBytes += allocation->size;
+		stats.usedBytes += allocation->size;
+	}
+
+	if (freeBytes > 0)
+		stats.fragmentation = 1.0f - static_cast<float>(largestFreeRange) / static_cast<float>(freeBytes);
+
+	return stats;
+}
+
+uint32_t DeviceAllocator::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const
+{
+	uint32_t fallback = UINT32_MAX;
+	for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; i++)
+	{
+		VkMemoryPropertyFlags flags = m_MemoryProperties.memoryTypes[i].propertyFlags;
+		if (!(typeFilter & (1 << i)) || (flags & required) != required)
+			continue;
+
+		if ((flags & preferred) == preferred)
+			return i;
+
+		if (fallback == UINT32_MAX)
+			fallback = i;
+	}
+
+	return fallback;
+}
+
+bool DeviceAllocator::IsHostVisible(uint32_t memoryTypeIndex) const
+{
+	return (m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
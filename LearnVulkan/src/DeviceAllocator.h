@@ -0,0 +1,133 @@
+#pragma once
+
+#include "HostAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+// Where an allocation should live, translated into memory property flags for the device at hand.
+enum class MemoryUsage
+{
+	GpuOnly,	// Device local, only written by transfers or shaders.
+	CpuToGpu,	// Host visible and coherent, for staging and data the CPU rewrites every frame.
+	GpuToCpu,	// Host visible and preferably cached, for readbacks.
+	GpuLazy		// Lazily allocated if the device has such memory, device local otherwise. Only for transient attachments.
+};
+
+struct DeviceAllocatorBlock;
+
+// A range of device memory handed out by DeviceAllocator. Owned by the allocator, release it with Free().
+struct Allocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	uint32_t memoryTypeIndex = 0;
+	// Persistently mapped pointer to offset, nullptr if the memory isn't host visible.
+	void* mapped = nullptr;
+
+	// Bookkeeping of the allocator, block is nullptr for dedicated allocations.
+	DeviceAllocatorBlock* block = nullptr;
+	uint32_t order = 0;
+};
+
+struct DeviceAllocatorStats
+{
+	// VkDeviceMemory objects, counted against maxMemoryAllocationCount.
+	uint32_t deviceMemoryCount = 0;
+	uint32_t maxDeviceMemoryCount = 0;
+	uint32_t blockCount = 0;
+	uint32_t dedicatedCount = 0;
+	uint32_t allocationCount = 0;
+	// Memory reserved from the driver, and the part of it handed out (after rounding to power of two sizes).
+	VkDeviceSize reservedBytes = 0;
+	VkDeviceSize usedBytes = 0;
+	// Bytes requested by callers, usedBytes - requestedBytes is lost to rounding.
+	VkDeviceSize requestedBytes = 0;
+	// 1 - largest free range / total free bytes across all blocks, 0 means all free memory is in one piece.
+	float fragmentation = 0.0f;
+};
+
+// Suballocates buffers and images from large VkDeviceMemory blocks instead of calling vkAllocateMemory per resource,
+// which is slow and limited to maxMemoryAllocationCount allocations.
+// Blocks are managed as buddy allocators, pooled per memory type and split between linear (buffers, linear images)
+// and optimal tiling resources, so neighbours never violate bufferImageGranularity.
+// Resources the driver prefers dedicated memory for, or that would take more than half a block, get their own allocation,
+// and so does lazily allocated memory, which is only committed as a tile-based GPU actually needs it.
+// Thread safe.
+class DeviceAllocator
+{
+public:
+	void Create(HostAllocator* hostAllocator, VkPhysicalDevice physicalDevice, VkDevice device);
+	void Destroy();
+
+	// Allocate memory for the resource and bind it. Throws if no memory type fits.
+	Allocation* AllocateBuffer(VkBuffer buffer, MemoryUsage usage);
+	Allocation* AllocateImage(VkImage image, VkImageTiling tiling, MemoryUsage usage);
+	// Memory for optimal tiling resources the caller binds itself, e.g. several images aliasing the same range.
+	Allocation* AllocateMemory(const VkMemoryRequirements& requirements, MemoryUsage usage);
+	// The GPU must be done with the resource bound to the allocation.
+	void Free(Allocation* allocation);
+
+	// Defragmentation support. Allocates and binds memory for buffer, a copy of current's buffer, in another block of the
+	// same pool. Returns nullptr instead of creating a block when none has room.
+	Allocation* AllocateBufferForMove(VkBuffer buffer, const Allocation* current);
+	// The least used block of every pool with more than one, if it is at most half full. Moving its allocations
+	// elsewhere lets the pool release it.
+	std::vector<const DeviceAllocatorBlock*> GetSparseBlocks();
+
+	DeviceAllocatorStats GetStats();
+	// Device memory this allocator has reserved from a heap, blocks and dedicated allocations alike.
+	VkDeviceSize GetHeapUsage(uint32_t heapIndex);
+	uint32_t GetHeapIndex(const Allocation* allocation) const { return m_MemoryProperties.memoryTypes[allocation->memoryTypeIndex].heapIndex; }
+	const VkPhysicalDeviceMemoryProperties& GetMemoryProperties() const { return m_MemoryProperties; }
+	// Memory type with all required flags, preferring one that also has the preferred flags. UINT32_MAX if none.
+	uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) const;
+private:
+	struct Pool
+	{
+		VkDeviceSize blockSize = 0;
+		uint32_t orderCount = 0;
+		std::vector<std::unique_ptr<DeviceAllocatorBlock>> blocks;
+	};
+private:
+	Allocation* Allocate(const VkMemoryRequirements& requirements, bool dedicated, bool linear, MemoryUsage usage,
+		VkBuffer buffer, VkImage image);
+	Allocation* AllocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, VkBuffer buffer, VkImage image);
+	Allocation* AllocateFromPool(Pool& pool, uint32_t memoryTypeIndex, VkDeviceSize size, const DeviceAllocatorBlock* excludedBlock = nullptr);
+	VkDeviceMemory AllocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, const void* pNext, void** mapped);
+	void FreeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryTypeIndex);
+	void FreeBlockRange(DeviceAllocatorBlock& block, VkDeviceSize offset, uint32_t order);
+	bool IsHostVisible(uint32_t memoryTypeIndex) const;
+private:
+	HostAllocator* m_HostAllocator = nullptr;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties m_MemoryProperties{};
+	uint32_t m_MaxDeviceMemoryCount = 0;
+	// Indexed by memoryTypeIndex * 2 + linear.
+	std::vector<Pool> m_Pools;
+	std::unordered_set<Allocation*> m_Dedicated;
+	uint32_t m_DeviceMemoryCount = 0;
+	std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> m_HeapUsage{};
+	uint32_t m_AllocationCount = 0;
+	VkDeviceSize m_RequestedBytes = 0;
+	std::mutex m_Mutex;
+};
+
+// One VkDeviceMemory of a pool. freeLists[order] holds the offsets of free ranges of s_MinAllocationSize << order bytes.
+struct DeviceAllocatorBlock
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	void* mapped = nullptr;
+	uint32_t memoryTypeIndex = 0;
+	uint32_t poolIndex = 0;
+	std::vector<std::unordered_set<VkDeviceSize>> freeLists;
+	VkDeviceSize usedBytes = 0;
+	uint32_t allocationCount = 0;
+};
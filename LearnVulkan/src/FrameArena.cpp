@@ -0,0 +1,55 @@
+#include "FrameArena.h"
+
+#include <bit>
+#include <new>
+
+void FrameArena::Create(size_t capacity)
+{
+	m_Capacity = capacity;
+	m_Memory = std::make_unique<std::byte[]>(m_Capacity);
+	m_Offset = 0;
+	m_UsedBytes = 0;
+}
+
+void FrameArena::Destroy()
+{
+	Reset();
+	m_Memory.reset();
+	m_Capacity = 0;
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	uintptr_t base = reinterpret_cast<uintptr_t>(m_Memory.get());
+	size_t offset = ((base + m_Offset + alignment - 1) & ~(alignment - 1)) - base;
+	m_UsedBytes += size;
+
+	if (offset + size <= m_Capacity)
+	{
+		m_Offset = offset + size;
+		return m_Memory.get() + offset;
+	}
+
+	// Counted as if it had been placed at the end of the arena, which is what the grown arena will do.
+	m_Offset = offset + size;
+	void* memory = ::operator new(size, std::align_val_t(alignment));
+	m_Overflow.emplace_back(memory, alignment);
+	return memory;
+}
+
+void FrameArena::Reset()
+{
+	for (const auto& [memory, alignment] : m_Overflow)
+		::operator delete(memory, std::align_val_t(alignment));
+
+	// Grow to what this frame needed, so the next one fits without overflowing.
+	if (!m_Overflow.empty())
+	{
+		m_Capacity = std::bit_ceil(m_Offset);
+		m_Memory = std::make_unique<std::byte[]>(m_Capacity);
+	}
+
+	m_Overflow.clear();
+	m_Offset = 0;
+	m_UsedBytes = 0;
+}
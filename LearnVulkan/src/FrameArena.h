@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+template<typename T>
+class ArenaAllocator;
+
+template<typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
+
+// Bump allocator for CPU data that lives as long as a frame slot, e.g. the containers built while recording it.
+// Nothing is freed individually, Reset() drops everything once the GPU is done with the slot's previous frame.
+// A frame needing more than the capacity falls back to the heap and the arena grows to the peak on the next Reset(),
+// so the steady state never touches the general heap. Destructors are not run on Reset(), only trivially destructible
+// data and containers that are destroyed before it may live here.
+// Like the frame slot it belongs to, an arena must only be used by one thread.
+class FrameArena
+{
+public:
+	void Create(size_t capacity);
+	void Destroy();
+
+	void* Allocate(size_t size, size_t alignment);
+	template<typename T>
+	T* Allocate(size_t count) { return static_cast<T*>(Allocate(count * sizeof(T), alignof(T))); }
+	// An empty vector with room for capacity elements.
+	template<typename T>
+	FrameVector<T> MakeVector(size_t capacity);
+
+	void Reset();
+
+	size_t GetUsedBytes() const { return m_UsedBytes; }
+	size_t GetCapacity() const { return m_Capacity; }
+	// Heap allocations since the last Reset(), 0 once the arena has grown to fit a frame.
+	uint32_t GetOverflowCount() const { return static_cast<uint32_t>(m_Overflow.size()); }
+private:
+	std::unique_ptr<std::byte[]> m_Memory;
+	size_t m_Capacity = 0;
+	size_t m_Offset = 0;
+	size_t m_UsedBytes = 0;
+	std::vector<std::pair<void*, size_t>> m_Overflow;
+};
+
+// Standard allocator handing out memory from a FrameArena, deallocation is a no-op.
+template<typename T>
+class ArenaAllocator
+{
+public:
+	using value_type = T;
+
+	explicit ArenaAllocator(FrameArena& arena) : m_Arena(&arena) {}
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : m_Arena(other.GetArena()) {}
+
+	T* allocate(size_t count) { return m_Arena->Allocate<T>(count); }
+	void deallocate(T*, size_t) {}
+
+	FrameArena* GetArena() const { return m_Arena; }
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return m_Arena == other.GetArena(); }
+private:
+	FrameArena* m_Arena;
+};
+
+template<typename T>
+FrameVector<T> FrameArena::MakeVector(size_t capacity)
+{
+	FrameVector<T> vector{ ArenaAllocator<T>(*this) };
+	vector.reserve(capacity);
+	return vector;
+}
@@ -0,0 +1,40 @@
+#include "FrameLimiter.h"
+
+#include <thread>
+
+void FrameLimiter::SetMaxFrameRate(double framesPerSecond)
+{
+	using namespace std::chrono;
+
+	if (framesPerSecond <= 0.0)
+		m_FramePeriod = steady_clock::duration::zero();
+	else
+		m_FramePeriod = duration_cast<steady_clock::duration>(duration<double>(1.0 / framesPerSecond));
+
+	m_NextFrame = steady_clock::now();
+}
+
+void FrameLimiter::Wait()
+{
+	using namespace std::chrono;
+
+	if (m_FramePeriod == steady_clock::duration::zero())
+		return;
+
+	auto now = steady_clock::now();
+	if (now < m_NextFrame)
+	{
+		// Sleeping regularly overshoots by a millisecond or more, so sleep for the bulk of the wait and yield for the rest.
+		const auto sleepMargin = milliseconds(2);
+		if (m_NextFrame - now > sleepMargin)
+			std::this_thread::sleep_until(m_NextFrame - sleepMargin);
+		while (steady_clock::now() < m_NextFrame)
+			std::this_thread::yield();
+		now = m_NextFrame;
+	}
+
+	// Keep a steady cadence, but don't rush frames out to catch up after a long hitch.
+	m_NextFrame += m_FramePeriod;
+	if (m_NextFrame < now)
+		m_NextFrame = now + m_FramePeriod;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <chrono>
+
+// Caps the frame rate on the CPU, for devices that can't pace presentation for us.
+class FrameLimiter
+{
+public:
+	// 0 or less removes the cap.
+	void SetMaxFrameRate(double framesPerSecond);
+	// Blocks until the next frame is due.
+	void Wait();
+private:
+	std::chrono::steady_clock::duration m_FramePeriod{ 0 };
+	std::chrono::steady_clock::time_point m_NextFrame{};
+};
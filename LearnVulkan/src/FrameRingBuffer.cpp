@@ -0,0 +1,60 @@
+#include "FrameRingBuffer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void FrameRingBuffer::Create(DeviceAllocator* allocator, HostAllocator* hostAllocator, VkDevice device, VkDeviceSize bytesPerFrame, uint32_t frameCount,
+	VkDeviceSize alignment, VkDeviceSize maxBindingRange)
+{
+	m_Device = device;
+	m_Allocator = allocator;
+	m_HostAllocator = hostAllocator;
+	m_Alignment = alignment;
+	// Keeps every frame's region aligned as well.
+	m_BytesPerFrame = (bytesPerFrame + m_Alignment - 1) / m_Alignment * m_Alignment;
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = m_BytesPerFrame * frameCount + maxBindingRange;
+	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(m_Device, &bufferInfo, m_HostAllocator->Get(VK_OBJECT_TYPE_BUFFER), &m_Buffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create frame ring buffer!");
+
+	m_Allocation = m_Allocator->AllocateBuffer(m_Buffer, MemoryUsage::CpuToGpu);
+
+	m_FrameBase = 0;
+	m_Head = 0;
+	m_PeakUsage = 0;
+}
+
+void FrameRingBuffer::Destroy()
+{
+	vkDestroyBuffer(m_Device, m_Buffer, m_HostAllocator->Get(VK_OBJECT_TYPE_BUFFER));
+	m_Allocator->Free(m_Allocation);
+	m_Buffer = VK_NULL_HANDLE;
+	m_Allocation = nullptr;
+}
+
+void FrameRingBuffer::BeginFrame(uint32_t frameIndex)
+{
+	m_PeakUsage = std::max(m_PeakUsage, m_Head.load(std::memory_order_relaxed));
+	m_FrameBase = m_BytesPerFrame * frameIndex;
+	m_Head.store(0, std::memory_order_relaxed);
+}
+
+RingAllocation FrameRingBuffer::Allocate(VkDeviceSize size)
+{
+	// Sizes are rounded up to the alignment, so the head stays aligned without a compare and swap loop.
+	VkDeviceSize alignedSize = (size + m_Alignment - 1) / m_Alignment * m_Alignment;
+	VkDeviceSize offset = m_Head.fetch_add(alignedSize, std::memory_order_relaxed);
+	if (offset + alignedSize > m_BytesPerFrame)
+		throw std::runtime_error("Frame ring buffer is full!");
+
+	RingAllocation allocation;
+	allocation.data = static_cast<char*>(m_Allocation->mapped) + m_FrameBase + offset;
+	allocation.offset = static_cast<uint32_t>(m_FrameBase + offset);
+	allocation.size = size;
+	return allocation;
+}
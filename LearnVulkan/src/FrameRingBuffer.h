@@ -0,0 +1,59 @@
+#pragma once
+
+#include "DeviceAllocator.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+// A range of the ring buffer for the frame being recorded. offset is the dynamic offset to bind it with.
+struct RingAllocation
+{
+	void* data = nullptr;
+	uint32_t offset = 0;
+	VkDeviceSize size = 0;
+};
+
+// One persistently mapped, host visible buffer split into a region per frame in flight. Per-draw and per-frame data is
+// bump allocated from the current frame's region and bound through dynamic uniform and storage buffer offsets, so
+// it costs a memcpy and no Vulkan objects. A region is reused once the GPU is done with that frame slot.
+// Allocations are lock free and may come from any recording thread.
+class FrameRingBuffer
+{
+public:
+	// Every allocation is aligned for both uniform and storage buffer use. The buffer is padded by maxBindingRange,
+	// so a descriptor range of up to that size stays in bounds at any offset.
+	void Create(DeviceAllocator* allocator, HostAllocator* hostAllocator, VkDevice device, VkDeviceSize bytesPerFrame, uint32_t frameCount,
+		VkDeviceSize alignment, VkDeviceSize maxBindingRange);
+	void Destroy();
+
+	// Switches to frameIndex's region. The GPU must be done with the frame that used it last.
+	void BeginFrame(uint32_t frameIndex);
+	// Throws if the current frame's region is full.
+	RingAllocation Allocate(VkDeviceSize size);
+	template<typename T>
+	RingAllocation Push(const T& value)
+	{
+		RingAllocation allocation = Allocate(sizeof(T));
+		memcpy(allocation.data, &value, sizeof(T));
+		return allocation;
+	}
+
+	VkBuffer GetBuffer() const { return m_Buffer; }
+	// Start of the current frame's region, for bindings that cover it as a whole.
+	uint32_t GetFrameOffset() const { return static_cast<uint32_t>(m_FrameBase); }
+	// Bytes allocated in the current frame so far, and the most any frame has used.
+	VkDeviceSize GetFrameUsage() const { return m_Head.load(std::memory_order_relaxed); }
+	VkDeviceSize GetPeakFrameUsage() const { return m_PeakUsage; }
+private:
+	VkDevice m_Device = VK_NULL_HANDLE;
+	DeviceAllocator* m_Allocator = nullptr;
+	HostAllocator* m_HostAllocator = nullptr;
+	VkBuffer m_Buffer = VK_NULL_HANDLE;
+	Allocation* m_Allocation = nullptr;
+	VkDeviceSize m_BytesPerFrame = 0;
+	VkDeviceSize m_Alignment = 0;
+	VkDeviceSize m_FrameBase = 0;
+	std::atomic<VkDeviceSize> m_Head = 0;
+	VkDeviceSize m_PeakUsage = 0;
+};
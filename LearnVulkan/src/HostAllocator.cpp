@@ -0,0 +1,258 @@
+#include "HostAllocator.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <new>
+
+static constexpr size_t s_MinBlockSize = 32;
+static constexpr size_t s_PageSize = 64 * 1024;
+static constexpr size_t s_HeaderAlignment = 16;
+static constexpr uint8_t s_NoSizeClass = 0xFF;
+
+// Right in front of every pointer handed to the driver.
+struct alignas(s_HeaderAlignment) AllocationHeader
+{
+	uint64_t size;
+	// Distance back to the start of the block, which for heap allocations is also their alignment.
+	uint32_t offset;
+	uint8_t sizeClass;
+	uint8_t scope;
+};
+static_assert(sizeof(AllocationHeader) == s_HeaderAlignment);
+
+void HostAllocator::Counters::Add(size_t size)
+{
+	size_t current = bytes += size;
+	allocations++;
+
+	size_t peak = peakBytes.load();
+	while (current > peak && !peakBytes.compare_exchange_weak(peak, current))
+		;
+}
+
+void HostAllocator::Destroy()
+{
+	for (void* page : m_Pages)
+		::operator delete(page, std::align_val_t(s_HeaderAlignment));
+	m_Pages.clear();
+
+	for (auto& sizeClass : m_SizeClasses)
+		sizeClass.freeList = nullptr;
+
+	m_ObjectTypes.clear();
+}
+
+const VkAllocationCallbacks* HostAllocator::Get(VkObjectType objectType)
+{
+	std::lock_guard lock(m_ObjectTypeMutex);
+
+	auto& entry = m_ObjectTypes[objectType];
+	if (!entry)
+	{
+		entry = std::make_unique<ObjectType>();
+		entry->allocator = this;
+		entry->objectType = objectType;
+		entry->callbacks.pUserData = entry.get();
+		entry->callbacks.pfnAllocation = AllocationCallback;
+		entry->callbacks.pfnReallocation = ReallocationCallback;
+		entry->callbacks.pfnFree = FreeCallback;
+		entry->callbacks.pfnInternalAllocation = InternalAllocationCallback;
+		entry->callbacks.pfnInternalFree = InternalFreeCallback;
+	}
+
+	return &entry->callbacks;
+}
+
+HostAllocationStats HostAllocator::GetStats()
+{
+	HostAllocationStats stats;
+	for (size_t scope = 0; scope < m_Scopes.size(); scope++)
+		stats.scopes[scope] = m_Scopes[scope].Load();
+	stats.internal = m_Internal.Load();
+
+	{
+		std::lock_guard lock(m_ObjectTypeMutex);
+		for (const auto& [type, entry] : m_ObjectTypes)
+			stats.objectTypes.emplace_back(type, entry->counters.Load());
+	}
+	std::sort(stats.objectTypes.begin(), stats.objectTypes.end(), [](const auto& a, const auto& b) {
+		return a.second.bytes > b.second.bytes;
+	});
+
+	{
+		std::lock_guard lock(m_PageMutex);
+		stats.pooledBytes = m_Pages.size() * s_PageSize;
+	}
+
+	return stats;
+}
+
+const char* HostAllocator::GetObjectTypeName(VkObjectType objectType)
+{
+	switch (objectType)
+	{
+	case VK_OBJECT_TYPE_INSTANCE: return "Instance";
+	case VK_OBJECT_TYPE_DEVICE: return "Device";
+	case VK_OBJECT_TYPE_SEMAPHORE: return "Semaphore";
+	case VK_OBJECT_TYPE_COMMAND_POOL: return "CommandPool";
+	case VK_OBJECT_TYPE_BUFFER: return "Buffer";
+	case VK_OBJECT_TYPE_IMAGE: return "Image";
+	case VK_OBJECT_TYPE_IMAGE_VIEW: return "ImageView";
+	case VK_OBJECT_TYPE_SHADER_MODULE: return "ShaderModule";
+	case VK_OBJECT_TYPE_PIPELINE_CACHE: return "PipelineCache";
+	case VK_OBJECT_TYPE_PIPELINE_LAYOUT: return "PipelineLayout";
+	case VK_OBJECT_TYPE_RENDER_PASS: return "RenderPass";
+	case VK_OBJECT_TYPE_PIPELINE: return "Pipeline";
+	case VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT: return "DescriptorSetLayout";
+	case VK_OBJECT_TYPE_DESCRIPTOR_POOL: return "DescriptorPool";
+	case VK_OBJECT_TYPE_FRAMEBUFFER: return "Framebuffer";
+	case VK_OBJECT_TYPE_SURFACE_KHR: return "Surface";
+	case VK_OBJECT_TYPE_SWAPCHAIN_KHR: return "Swapchain";
+	case VK_OBJECT_TYPE_DEBUG_UTILS_MESSENGER_EXT: return "DebugUtilsMessenger";
+	default: return "Other";
+	}
+}
+
+void* HostAllocator::Allocate(ObjectType& objectType, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	if (size == 0)
+		return nullptr;
+
+	char* block;
+	uint32_t offset;
+	uint8_t sizeClass = s_NoSizeClass;
+
+	size_t blockSize = std::max(std::bit_ceil(size + sizeof(AllocationHeader)), s_MinBlockSize);
+	if (alignment <= s_HeaderAlignment && blockSize <= (s_MinBlockSize << (s_SizeClassCount - 1)))
+	{
+		sizeClass = static_cast<uint8_t>(std::countr_zero(blockSize / s_MinBlockSize));
+		block = static_cast<char*>(AllocateFromSizeClass(sizeClass));
+		offset = sizeof(AllocationHeader);
+	}
+	else
+	{
+		// Aligning the block itself keeps the header, which fits in the alignment, in front of an aligned pointer.
+		offset = static_cast<uint32_t>(std::max(alignment, s_HeaderAlignment));
+		block = static_cast<char*>(::operator new(size + offset, std::align_val_t(offset), std::nothrow));
+	}
+
+	// Vulkan expects nullptr rather than an exception, it reports VK_ERROR_OUT_OF_HOST_MEMORY.
+	if (block == nullptr)
+		return nullptr;
+
+	char* memory = block + offset;
+	AllocationHeader* header = reinterpret_cast<AllocationHeader*>(memory) - 1;
+	header->size = size;
+	header->offset = offset;
+	header->sizeClass = sizeClass;
+	header->scope = static_cast<uint8_t>(scope);
+
+	objectType.counters.Add(size);
+	m_Scopes[scope].Add(size);
+	return memory;
+}
+
+void* HostAllocator::Reallocate(ObjectType& objectType, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	if (original == nullptr)
+		return Allocate(objectType, size, alignment, scope);
+
+	if (size == 0)
+	{
+		Free(objectType, original);
+		return nullptr;
+	}
+
+	void* memory = Allocate(objectType, size, alignment, scope);
+	if (memory == nullptr)
+		return nullptr;
+
+	const AllocationHeader* header = static_cast<const AllocationHeader*>(original) - 1;
+	std::memcpy(memory, original, std::min<size_t>(header->size, size));
+	Free(objectType, original);
+	return memory;
+}
+
+void HostAllocator::Free(ObjectType& objectType, void* memory)
+{
+	if (memory == nullptr)
+		return;
+
+	AllocationHeader* header = static_cast<AllocationHeader*>(memory) - 1;
+	objectType.counters.Remove(header->size);
+	m_Scopes[header->scope].Remove(header->size);
+
+	char* block = static_cast<char*>(memory) - header->offset;
+	if (header->sizeClass == s_NoSizeClass)
+	{
+		::operator delete(block, std::align_val_t(header->offset));
+		return;
+	}
+
+	SizeClass& sizeClass = m_SizeClasses[header->sizeClass];
+	std::lock_guard lock(sizeClass.mutex);
+	*reinterpret_cast<void**>(block) = sizeClass.freeList;
+	sizeClass.freeList = block;
+}
+
+void* HostAllocator::AllocateFromSizeClass(uint32_t sizeClassIndex)
+{
+	SizeClass& sizeClass = m_SizeClasses[sizeClassIndex];
+	std::lock_guard lock(sizeClass.mutex);
+
+	if (sizeClass.freeList == nullptr)
+	{
+		char* page = static_cast<char*>(::operator new(s_PageSize, std::align_val_t(s_HeaderAlignment), std::nothrow));
+		if (page == nullptr)
+			return nullptr;
+
+		{
+			std::lock_guard pageLock(m_PageMutex);
+			m_Pages.push_back(page);
+		}
+
+		// Pages are never returned, each size class keeps what its peak needed.
+		size_t blockSize = s_MinBlockSize << sizeClassIndex;
+		for (size_t offset = s_PageSize; offset >= blockSize; offset -= blockSize)
+		{
+			char* block = page + offset - blockSize;
+			*reinterpret_cast<void**>(block) = sizeClass.freeList;
+			sizeClass.freeList = block;
+		}
+	}
+
+	void* block = sizeClass.freeList;
+	sizeClass.freeList = *static_cast<void**>(block);
+	return block;
+}
+
+VKAPI_ATTR void* VKAPI_CALL HostAllocator::AllocationCallback(void* pUserData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	ObjectType& objectType = *static_cast<ObjectType*>(pUserData);
+	return objectType.allocator->Allocate(objectType, size, alignment, scope);
+}
+
+VKAPI_ATTR void* VKAPI_CALL HostAllocator::ReallocationCallback(void* pUserData, void* pOriginal, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	ObjectType& objectType = *static_cast<ObjectType*>(pUserData);
+	return objectType.allocator->Reallocate(objectType, pOriginal, size, alignment, scope);
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::FreeCallback(void* pUserData, void* pMemory)
+{
+	ObjectType& objectType = *static_cast<ObjectType*>(pUserData);
+	objectType.allocator->Free(objectType, pMemory);
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::InternalAllocationCallback(void* pUserData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+	ObjectType& objectType = *static_cast<ObjectType*>(pUserData);
+	objectType.allocator->m_Internal.Add(size);
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::InternalFreeCallback(void* pUserData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+	ObjectType& objectType = *static_cast<ObjectType*>(pUserData);
+	objectType.allocator->m_Internal.Remove(size);
+}
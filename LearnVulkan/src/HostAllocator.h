@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct HostAllocationCounters
+{
+	size_t bytes = 0;
+	size_t peakBytes = 0;
+	uint64_t allocations = 0;
+};
+
+struct HostAllocationStats
+{
+	// Indexed by VkSystemAllocationScope.
+	std::array<HostAllocationCounters, VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1> scopes;
+	// One entry per object type that was passed to Get(), sorted by bytes.
+	std::vector<std::pair<VkObjectType, HostAllocationCounters>> objectTypes;
+	// Memory the driver allocated on its own and only reported, e.g. for executable code.
+	HostAllocationCounters internal;
+	// Bytes of small allocation pages reserved from the system heap.
+	size_t pooledBytes = 0;
+};
+
+// VkAllocationCallbacks that route driver host allocations through size class pools and count them per allocation
+// scope and per Vulkan object type. Vulkan doesn't say which object an allocation belongs to, so every object type gets
+// callbacks of its own: pass Get(type) to both the create and the destroy call of an object.
+// Allocations of up to 4KB with at most 16 byte alignment come from the pools, larger ones from the system heap.
+// Thread safe, drivers call back from whichever thread called into them.
+class HostAllocator
+{
+public:
+	// Everything allocated through the callbacks must have been freed, i.e. the instance destroyed.
+	void Destroy();
+
+	const VkAllocationCallbacks* Get(VkObjectType objectType);
+	HostAllocationStats GetStats();
+	static const char* GetObjectTypeName(VkObjectType objectType);
+private:
+	struct Counters
+	{
+		std::atomic<size_t> bytes = 0;
+		std::atomic<size_t> peakBytes = 0;
+		std::atomic<uint64_t> allocations = 0;
+
+		void Add(size_t size);
+		void Remove(size_t size) { bytes -= size; }
+		HostAllocationCounters Load() const { return { bytes.load(), peakBytes.load(), allocations.load() }; }
+	};
+
+	// pUserData of the callbacks handed out for one object type.
+	struct ObjectType
+	{
+		HostAllocator* allocator = nullptr;
+		VkObjectType objectType = VK_OBJECT_TYPE_UNKNOWN;
+		VkAllocationCallbacks callbacks{};
+		Counters counters;
+	};
+
+	struct SizeClass
+	{
+		std::mutex mutex;
+		void* freeList = nullptr;
+	};
+private:
+	void* Allocate(ObjectType& objectType, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	void* Reallocate(ObjectType& objectType, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	void Free(ObjectType& objectType, void* memory);
+	void* AllocateFromSizeClass(uint32_t sizeClass);
+
+	static VKAPI_ATTR void* VKAPI_CALL AllocationCallback(void* pUserData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void* VKAPI_CALL ReallocationCallback(void* pUserData, void* pOriginal, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void VKAPI_CALL FreeCallback(void* pUserData, void* pMemory);
+	static VKAPI_ATTR void VKAPI_CALL InternalAllocationCallback(void* pUserData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void VKAPI_CALL InternalFreeCallback(void* pUserData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+private:
+	static constexpr uint32_t s_SizeClassCount = 8;	// 32 bytes to 4KB, header included
+	std::array<SizeClass, s_SizeClassCount> m_SizeClasses;
+	std::mutex m_PageMutex;
+	std::vector<void*> m_Pages;
+	std::array<Counters, VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1> m_Scopes;
+	Counters m_Internal;
+	std::mutex m_ObjectTypeMutex;
+	std::unordered_map<VkObjectType, std::unique_ptr<ObjectType>> m_ObjectTypes;
+};
@@ -0,0 +1,147 @@
+#include "MemoryBudget.h"
+
+#include <algorithm>
+#include <vector>
+
+// Start evicting above this share of the budget, and stop once usage is back below the lower one.
+static constexpr double s_EvictionThreshold = 0.9;
+static constexpr double s_EvictionTarget = 0.8;
+// Share of a heap assumed to be available when the driver can't tell us.
+static constexpr double s_FallbackBudget = 0.8;
+
+void MemoryBudget::Create(VkPhysicalDevice physicalDevice, DeviceAllocator* allocator, DeletionQueue* deletionQueue, bool budgetExtensionEnabled)
+{
+	m_PhysicalDevice = physicalDevice;
+	m_Allocator = allocator;
+	m_DeletionQueue = deletionQueue;
+	m_BudgetExtensionEnabled = budgetExtensionEnabled;
+
+	Sample();
+}
+
+void MemoryBudget::Update(uint64_t frame)
+{
+	m_Frame = frame;
+	m_Evictions = 0;
+
+	Sample();
+
+	for (uint32_t heapIndex = 0; heapIndex < m_HeapCount; heapIndex++)
+		if (m_Heaps[heapIndex].usage > m_Heaps[heapIndex].budget * s_EvictionThreshold)
+			Evict(heapIndex);
+
+	m_TotalEvictions += m_Evictions;
+}
+
+void MemoryBudget::Sample()
+{
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+	budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+	VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+	memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	memoryProperties.pNext = m_BudgetExtensionEnabled ? &budgetProperties : nullptr;
+	vkGetPhysicalDeviceMemoryProperties2(m_PhysicalDevice, &memoryProperties);
+
+	m_HeapCount = memoryProperties.memoryProperties.memoryHeapCount;
+	for (uint32_t i = 0; i < m_HeapCount; i++)
+	{
+		const VkMemoryHeap& heap = memoryProperties.memoryProperties.memoryHeaps[i];
+		HeapBudget& budget = m_Heaps[i];
+		budget.deviceLocal = (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+
+		if (m_BudgetExtensionEnabled)
+		{
+			budget.budget = budgetProperties.heapBudget[i];
+			budget.usage = budgetProperties.heapUsage[i];
+		}
+		else
+		{
+			budget.budget = static_cast<VkDeviceSize>(heap.size * s_FallbackBudget);
+			budget.usage = m_Allocator->GetHeapUsage(i);
+		}
+		budget.usage -= std::min(budget.usage, budget.pendingEvictions);
+	}
+}
+
+void MemoryBudget::Evict(uint32_t heapIndex)
+{
+	HeapBudget& heap = m_Heaps[heapIndex];
+	VkDeviceSize target = static_cast<VkDeviceSize>(heap.budget * s_EvictionTarget);
+
+	// Collected under the lock but run without it, the callbacks may unregister or register resources.
+	std::vector<std::function<void()>> evictions;
+	VkDeviceSize evictedBytes = 0;
+	{
+		std::lock_guard lock(m_Mutex);
+		for (auto it = m_Streamables.begin(); it != m_Streamables.end() && heap.usage > target;)
+		{
+			// Anything the previous frame drew is likely to be drawn again right away.
+			if (it->lastUsedFrame + 1 >= m_Frame)
+				break;
+
+			if (it->heapIndex != heapIndex)
+			{
+				++it;
+				continue;
+			}
+
+			// The memory only comes back once the owner's deferred free runs, count it as gone now so
+			// this frame doesn't evict more than it needs to.
+			heap.usage -= std::min(heap.usage, it->size);
+			evictedBytes += it->size;
+			evictions.push_back(std::move(it->evict));
+			m_StreamableLookup.erase(it->id);
+			it = m_Streamables.erase(it);
+		}
+	}
+
+	for (auto& evict : evictions)
+		evict();
+
+	// Queued behind the owners' destructions, which run in order, so the bytes stop being pending once they're freed.
+	if (evictedBytes > 0)
+	{
+		heap.pendingEvictions += evictedBytes;
+		m_DeletionQueue->Push([this, heapIndex, evictedBytes]() {
+			m_Heaps[heapIndex].pendingEvictions -= evictedBytes;
+		});
+	}
+
+	m_Evictions += static_cast<uint32_t>(evictions.size());
+}
+
+MemoryBudget::StreamableId MemoryBudget::RegisterStreamable(const Allocation* allocation, std::function<void()> evict)
+{
+	std::lock_guard lock(m_Mutex);
+
+	StreamableId id = m_NextId++;
+	m_Streamables.push_back({ id, m_Allocator->GetHeapIndex(allocation), allocation->size, m_Frame, std::move(evict) });
+	m_StreamableLookup[id] = std::prev(m_Streamables.end());
+	return id;
+}
+
+void MemoryBudget::UnregisterStreamable(StreamableId id)
+{
+	std::lock_guard lock(m_Mutex);
+
+	auto it = m_StreamableLookup.find(id);
+	if (it == m_StreamableLookup.end())
+		return;
+
+	m_Streamables.erase(it->second);
+	m_StreamableLookup.erase(it);
+}
+
+void MemoryBudget::MarkUsed(StreamableId id)
+{
+	std::lock_guard lock(m_Mutex);
+
+	auto it = m_StreamableLookup.find(id);
+	if (it == m_StreamableLookup.end())
+		return;
+
+	// Moving to the back keeps the list in least recently used order without sorting.
+	it->second->lastUsedFrame = m_Frame;
+	m_Streamables.splice(m_Streamables.end(), m_Streamables, it->second);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "DeletionQueue.h"
+#include "DeviceAllocator.h"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+struct HeapBudget
+{
+	// What the process may use of the heap right now, and what it uses, as reported by VK_EXT_memory_budget.
+	// Without the extension the budget is a fixed share of the heap and usage only counts the DeviceAllocator.
+	VkDeviceSize budget = 0;
+	VkDeviceSize usage = 0;
+	// Evicted bytes whose deferred free hasn't run yet. The sampled usage still includes them, usage above doesn't.
+	VkDeviceSize pendingEvictions = 0;
+	bool deviceLocal = false;
+};
+
+// Samples the per-heap memory budget every frame and evicts streamable resources (textures, meshes, ...) in least
+// recently used order once a heap's usage nears its budget, before allocations start failing.
+// Owners register each streamable resource with a callback that releases it, mark it used in every frame that draws it,
+// and load it again on demand. The callback runs on the render thread and has to defer the destruction until the GPU is
+// done with the resource, with DeletionQueue::Push(destroy) on the queue given to Create(). Until the destructions
+// queued by an eviction have run, its memory counts as freed already, so later frames don't evict the same bytes again.
+class MemoryBudget
+{
+public:
+	using StreamableId = uint64_t;
+
+	void Create(VkPhysicalDevice physicalDevice, DeviceAllocator* allocator, DeletionQueue* deletionQueue, bool budgetExtensionEnabled);
+
+	// Refreshes the budgets and evicts what has to go. Call once per frame, before recording, with an increasing frame number.
+	void Update(uint64_t frame);
+
+	// Thread safe, so recording threads can mark the resources they draw.
+	StreamableId RegisterStreamable(const Allocation* allocation, std::function<void()> evict);
+	void UnregisterStreamable(StreamableId id);
+	void MarkUsed(StreamableId id);
+
+	const HeapBudget& GetHeapBudget(uint32_t heapIndex) const { return m_Heaps[heapIndex]; }
+	uint32_t GetHeapCount() const { return m_HeapCount; }
+	// Evictions during the last Update(), and in total.
+	uint32_t GetEvictions() const { return m_Evictions; }
+	uint64_t GetTotalEvictions() const { return m_TotalEvictions; }
+private:
+	struct Streamable
+	{
+		StreamableId id;
+		uint32_t heapIndex;
+		VkDeviceSize size;
+		uint64_t lastUsedFrame;
+		std::function<void()> evict;
+	};
+private:
+	void Sample();
+	void Evict(uint32_t heapIndex);
+private:
+	VkPhysicalDevice m_PhysicalDevice = VK_NULL_HANDLE;
+	DeviceAllocator* m_Allocator = nullptr;
+	DeletionQueue* m_DeletionQueue = nullptr;
+	bool m_BudgetExtensionEnabled = false;
+	uint32_t m_HeapCount = 0;
+	std::array<HeapBudget, VK_MAX_MEMORY_HEAPS> m_Heaps{};
+	// Least recently used first.
+	std::list<Streamable> m_Streamables;
+	std::unordered_map<StreamableId, std::list<Streamable>::iterator> m_StreamableLookup;
+	StreamableId m_NextId = 1;
+	uint64_t m_Frame = 0;
+	uint32_t m_Evictions = 0;
+	uint64_t m_TotalEvictions = 0;
+	std::mutex m_Mutex;
+};
@@ -0,0 +1,158 @@
+#include "PipelineCache.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+static constexpr uint32_t s_FileMagic = 0x48435056; // "VPCH"
+static constexpr uint32_t s_FileVersion = 1;
+
+struct PipelineCacheFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t dataSize;
+	uint64_t dataHash;
+	// Drivers are supposed to change pipelineCacheUUID whenever their blobs become incompatible, not all of them do.
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+static uint64_t HashData(const char* data, size_t size)
+{
+	// FNV-1a, only meant to catch truncated and corrupted files.
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= static_cast<uint8_t>(data[i]);
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+void PipelineCache::Create(VkPhysicalDevice physicalDevice, VkDevice device, const std::filesystem::path& path, const VkAllocationCallbacks* allocator)
+{
+	m_Device = device;
+	m_Path = path;
+	m_Allocator = allocator;
+	vkGetPhysicalDeviceProperties(physicalDevice, &m_Properties);
+
+	std::vector<char> data = Load();
+
+	VkPipelineCacheCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = data.size();
+	createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	VkResult result = vkCreatePipelineCache(m_Device, &createInfo, m_Allocator, &m_Cache);
+	if (result != VK_SUCCESS && !data.empty())
+	{
+		// The driver may still reject a blob that passed our checks, starting over is always fine.
+		data.clear();
+		createInfo.initialDataSize = 0;
+		createInfo.pInitialData = nullptr;
+		result = vkCreatePipelineCache(m_Device, &createInfo, m_Allocator, &m_Cache);
+	}
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create pipeline cache!");
+
+	m_LoadedSize = data.size();
+	m_SavedSize = data.size();
+}
+
+void PipelineCache::Destroy()
+{
+	if (!Save())
+		std::cerr << "Failed to save pipeline cache to " << m_Path.string() << "\n";
+
+	vkDestroyPipelineCache(m_Device, m_Cache, m_Allocator);
+	m_Cache = VK_NULL_HANDLE;
+}
+
+bool PipelineCache::Save()
+{
+	size_t size = 0;
+	if (vkGetPipelineCacheData(m_Device, m_Cache, &size, nullptr) != VK_SUCCESS)
+		return false;
+
+	// Caches only grow, so an unchanged size means nothing was added.
+	if (size == m_SavedSize)
+		return true;
+
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(m_Device, m_Cache, &size, data.data()) != VK_SUCCESS)
+		return false;
+	data.resize(size);
+
+	PipelineCacheFileHeader header{};
+	header.magic = s_FileMagic;
+	header.version = s_FileVersion;
+	header.dataSize = data.size();
+	header.dataHash = HashData(data.data(), data.size());
+	header.vendorID = m_Properties.vendorID;
+	header.deviceID = m_Properties.deviceID;
+	header.driverVersion = m_Properties.driverVersion;
+	std::memcpy(header.pipelineCacheUUID, m_Properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+	std::filesystem::path tempPath = m_Path;
+	tempPath += ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(data.data(), data.size());
+		if (!file.good())
+			return false;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, m_Path, error);
+	if (error)
+		return false;
+
+	m_SavedSize = data.size();
+	return true;
+}
+
+std::vector<char> PipelineCache::Load()
+{
+	std::ifstream file(m_Path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return {};
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	if (fileSize < sizeof(PipelineCacheFileHeader))
+		return {};
+
+	PipelineCacheFileHeader header{};
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (header.magic != s_FileMagic || header.version != s_FileVersion || header.dataSize != fileSize - sizeof(header))
+		return {};
+
+	if (header.vendorID != m_Properties.vendorID || header.deviceID != m_Properties.deviceID ||
+		header.driverVersion != m_Properties.driverVersion ||
+		std::memcmp(header.pipelineCacheUUID, m_Properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		return {};
+
+	std::vector<char> data(header.dataSize);
+	file.read(data.data(), data.size());
+	if (!file.good() || HashData(data.data(), data.size()) != header.dataHash)
+		return {};
+
+	// The driver's own header has to agree as well, it is what the driver checks before trusting the rest.
+	VkPipelineCacheHeaderVersionOne cacheHeader{};
+	if (data.size() < sizeof(cacheHeader))
+		return {};
+	std::memcpy(&cacheHeader, data.data(), sizeof(cacheHeader));
+	if (cacheHeader.headerSize < sizeof(cacheHeader) || cacheHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+		cacheHeader.vendorID != m_Properties.vendorID || cacheHeader.deviceID != m_Properties.deviceID ||
+		std::memcmp(cacheHeader.pipelineCacheUUID, m_Properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		return {};
+
+	return data;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// A VkPipelineCache persisted to disk, so pipelines compiled in one run are only looked up in the next.
+// The file is a small header of our own (size, checksum and the device it came from) followed by the driver's blob.
+// A file that is truncated, corrupt, or from another device or driver version is discarded and the cache starts empty.
+// Saving writes a temporary file and renames it over the old one, so a crash mid-save never leaves a torn file behind.
+class PipelineCache
+{
+public:
+	void Create(VkPhysicalDevice physicalDevice, VkDevice device, const std::filesystem::path& path, const VkAllocationCallbacks* allocator);
+	// Saves and destroys the cache.
+	void Destroy();
+
+	// Writes the cache if it grew since the last save. Returns false if writing failed, the old file then stays as it was.
+	bool Save();
+
+	VkPipelineCache Get() const { return m_Cache; }
+	// Size of the blob loaded at startup, 0 if there was no usable file.
+	size_t GetLoadedSize() const { return m_LoadedSize; }
+private:
+	std::vector<char> Load();
+private:
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties m_Properties{};
+	std::filesystem::path m_Path;
+	const VkAllocationCallbacks* m_Allocator = nullptr;
+	VkPipelineCache m_Cache = VK_NULL_HANDLE;
+	size_t m_LoadedSize = 0;
+	size_t m_SavedSize = 0;
+};
@@ -0,0 +1,265 @@
+#include "PipelineCompiler.h"
+
+#include <array>
+#include <chrono>
+#include <stdexcept>
+
+void PipelineCompiler::Create(VkDevice device, VkPipelineCache cache, const VkAllocationCallbacks* allocator, uint32_t threadCount, bool pipelineLibraries)
+{
+	m_Device = device;
+	m_Cache = cache;
+	m_Allocator = allocator;
+	m_PipelineLibraries = pipelineLibraries;
+	m_Pool = std::make_unique<ThreadPool>(threadCount);
+}
+
+void PipelineCompiler::Destroy()
+{
+	// The pool runs every queued job before its threads exit.
+	m_Pool.reset();
+}
+
+std::shared_future<VkPipeline> PipelineCompiler::Compile(const PipelineDesc& desc)
+{
+	VkGraphicsPipelineLibraryFlagsEXT allParts = 0;
+	for (auto part : s_LibraryParts)
+		allParts |= part;
+
+	return Submit([this, desc, allParts]() {
+		return CreateGraphicsPipeline(desc, allParts, 0, {});
+	});
+}
+
+std::shared_future<VkPipeline> PipelineCompiler::Compile(const ComputePipelineDesc& desc)
+{
+	return Submit([this, desc]() {
+		return CreateComputePipeline(desc);
+	});
+}
+
+std::shared_future<VkPipeline> PipelineCompiler::CompileLibrary(const PipelineDesc& desc, VkGraphicsPipelineLibraryFlagBitsEXT part)
+{
+	// Keeping the link time optimization info lets optimized links use the libraries as well.
+	return Submit([this, desc = desc.ForLibrary(part), part]() {
+		return CreateGraphicsPipeline(desc, part, VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT, {});
+	});
+}
+
+std::shared_future<VkPipeline> PipelineCompiler::Link(const PipelineDesc& desc, const LibraryFutures& libraries, bool optimize)
+{
+	// Jobs start in submission order and the libraries were submitted first, so waiting for them here can't take
+	// the last free worker away from one of them.
+	return Submit([this, desc, libraries, optimize]() {
+		std::array<VkPipeline, s_LibraryParts.size()> handles;
+		for (size_t i = 0; i < handles.size(); i++)
+			handles[i] = libraries[i].get();
+
+		VkPipelineCreateFlags flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+		return CreateGraphicsPipeline(desc, 0, flags, handles);
+	});
+}
+
+VkPipeline PipelineCompiler::TryGet(const std::shared_future<VkPipeline>& future)
+{
+	if (!future.valid() || future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return VK_NULL_HANDLE;
+	return future.get();
+}
+
+VkPipeline PipelineCompiler::CreateGraphicsPipeline(const PipelineDesc& desc, VkGraphicsPipelineLibraryFlagsEXT parts, VkPipelineCreateFlags flags,
+	std::span<const VkPipeline> libraries) const
+{
+	bool vertexInput = parts & VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT;
+	bool preRasterization = parts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+	bool fragmentShader = parts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT;
+	bool fragmentOutput = parts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+
+	// Each stage only gets the constants it declares, the data is shared.
+	std::array<VkSpecializationMapEntry, PipelineDesc::s_MaxSpecializationConstants> specializationEntries[2];
+	VkSpecializationInfo specializationInfos[2]{};
+	const VkShaderStageFlagBits specializedStages[2] = { VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+	for (uint32_t stage = 0; stage < 2; stage++)
+	{
+		uint32_t mask = desc.GetStageSpecializationMask(specializedStages[stage]);
+		for (uint32_t i = 0; i < PipelineDesc::s_MaxSpecializationConstants; i++)
+		{
+			if (mask & (1u << i))
+				specializationEntries[stage][specializationInfos[stage].mapEntryCount++] = { i, static_cast<uint32_t>(i * sizeof(uint32_t)), sizeof(uint32_t) };
+		}
+		specializationInfos[stage].pMapEntries = specializationEntries[stage].data();
+		specializationInfos[stage].dataSize = sizeof(desc.specializationData);
+		specializationInfos[stage].pData = desc.specializationData.data();
+	}
+
+	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	vertShaderStageInfo.module = desc.vertexShader;
+	vertShaderStageInfo.pName = "main";
+	vertShaderStageInfo.pSpecializationInfo = specializationInfos[0].mapEntryCount > 0 ? &specializationInfos[0] : nullptr;
+
+	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	fragShaderStageInfo.module = desc.fragmentShader;
+	fragShaderStageInfo.pName = "main";
+	fragShaderStageInfo.pSpecializationInfo = specializationInfos[1].mapEntryCount > 0 ? &specializationInfos[1] : nullptr;
+
+	VkPipelineShaderStageCreateInfo shaderStages[2];
+	uint32_t stageCount = 0;
+	if (preRasterization)
+		shaderStages[stageCount++] = vertShaderStageInfo;
+	if (fragmentShader)
+		shaderStages[stageCount++] = fragShaderStageInfo;
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = desc.vertexBindingCount;
+	vertexInputInfo.pVertexBindingDescriptions = desc.vertexBindings.data();
+	vertexInputInfo.vertexAttributeDescriptionCount = desc.vertexAttributeCount;
+	vertexInputInfo.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = desc.topology;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
+
+	// Both are dynamic, only the counts are used.
+	VkPipelineViewportStateCreateInfo viewportState{};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = desc.polygonMode;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = desc.cullMode;
+	rasterizer.frontFace = desc.frontFace;
+	rasterizer.depthBiasEnable = VK_FALSE;
+	rasterizer.depthBiasConstantFactor = 0.0f; // Optional
+	rasterizer.depthBiasClamp = 0.0f; // Optional
+	rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
+
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = desc.samples;
+	multisampling.minSampleShading = 1.0f; // Optional
+	multisampling.pSampleMask = nullptr; // Optional
+	multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
+	multisampling.alphaToOneEnable = VK_FALSE; // Optional
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = desc.depthTest;
+	depthStencil.depthWriteEnable = desc.depthWrite;
+	depthStencil.depthCompareOp = desc.depthCompareOp;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.stencilTestEnable = VK_FALSE;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = desc.colorWriteMask;
+	colorBlendAttachment.blendEnable = desc.blendEnable;
+	colorBlendAttachment.srcColorBlendFactor = desc.srcColorBlendFactor;
+	colorBlendAttachment.dstColorBlendFactor = desc.dstColorBlendFactor;
+	colorBlendAttachment.colorBlendOp = desc.colorBlendOp;
+	colorBlendAttachment.srcAlphaBlendFactor = desc.srcAlphaBlendFactor;
+	colorBlendAttachment.dstAlphaBlendFactor = desc.dstAlphaBlendFactor;
+	colorBlendAttachment.alphaBlendOp = desc.alphaBlendOp;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending{};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
+	colorBlending.attachmentCount = desc.renderPass != VK_NULL_HANDLE || desc.colorFormat != VK_FORMAT_UNDEFINED ? 1 : 0;
+	colorBlending.pAttachments = &colorBlendAttachment;
+	colorBlending.blendConstants[0] = 0.0f; // Optional
+	colorBlending.blendConstants[1] = 0.0f; // Optional
+	colorBlending.blendConstants[2] = 0.0f; // Optional
+	colorBlending.blendConstants[3] = 0.0f; // Optional
+
+	VkPipelineRenderingCreateInfo renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	renderingInfo.colorAttachmentCount = desc.colorFormat != VK_FORMAT_UNDEFINED ? 1 : 0;
+	renderingInfo.pColorAttachmentFormats = &desc.colorFormat;
+	renderingInfo.depthAttachmentFormat = desc.depthFormat;
+
+	VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+	libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+	libraryInfo.flags = parts;
+
+	VkPipelineLibraryCreateInfoKHR linkInfo{};
+	linkInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+	linkInfo.libraryCount = static_cast<uint32_t>(libraries.size());
+	linkInfo.pLibraries = libraries.data();
+
+	const void* pNext = nullptr;
+	if (flags & VK_PIPELINE_CREATE_LIBRARY_BIT_KHR)
+		pNext = &libraryInfo;
+	else if (!libraries.empty())
+		pNext = &linkInfo;
+
+	// Only read without a render pass.
+	if (desc.renderPass == VK_NULL_HANDLE)
+	{
+		renderingInfo.pNext = pNext;
+		pNext = &renderingInfo;
+	}
+
+	// Each part only passes its own state, a link passes none and takes everything from the libraries.
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext = pNext;
+	pipelineInfo.flags = flags;
+	pipelineInfo.stageCount = stageCount;
+	pipelineInfo.pStages = stageCount > 0 ? shaderStages : nullptr;
+	pipelineInfo.pVertexInputState = vertexInput ? &vertexInputInfo : nullptr;
+	pipelineInfo.pInputAssemblyState = vertexInput ? &inputAssembly : nullptr;
+	pipelineInfo.pViewportState = preRasterization ? &viewportState : nullptr;
+	pipelineInfo.pRasterizationState = preRasterization ? &rasterizer : nullptr;
+	pipelineInfo.pMultisampleState = fragmentShader || fragmentOutput ? &multisampling : nullptr;
+	pipelineInfo.pDepthStencilState = fragmentShader ? &depthStencil : nullptr;
+	pipelineInfo.pColorBlendState = fragmentOutput ? &colorBlending : nullptr;
+	pipelineInfo.pDynamicState = preRasterization ? &dynamicState : nullptr;
+	pipelineInfo.layout = desc.layout;
+	pipelineInfo.renderPass = desc.renderPass;
+	pipelineInfo.subpass = desc.subpass;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
+	pipelineInfo.basePipelineIndex = -1; // Optional
+
+	// Pipeline caches are internally synchronized, every worker can use the same one.
+	VkPipeline pipeline;
+	if (vkCreateGraphicsPipelines(m_Device, m_Cache, 1, &pipelineInfo, m_Allocator, &pipeline) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create graphics pipeline!");
+
+	return pipeline;
+}
+
+VkPipeline PipelineCompiler::CreateComputePipeline(const ComputePipelineDesc& desc) const
+{
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = desc.shader;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = desc.layout;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
+	pipelineInfo.basePipelineIndex = -1; // Optional
+
+	VkPipeline pipeline;
+	if (vkCreateComputePipelines(m_Device, m_Cache, 1, &pipelineInfo, m_Allocator, &pipeline) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create compute pipeline!");
+
+	return pipeline;
+}
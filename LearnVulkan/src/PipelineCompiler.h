@@ -0,0 +1,90 @@
+#pragma once
+
+#include "PipelineDesc.h"
+#include "ThreadPool.h"
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <span>
+
+struct ComputePipelineDesc
+{
+	VkShaderModule shader = VK_NULL_HANDLE;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+};
+
+// Creates pipelines on worker threads of its own, so a compile never stalls the frame loop or the recording workers.
+// Callers poll the returned futures once per frame and skip what isn't ready yet.
+// Pipelines are created through the pipeline cache, a compile the cache already knows finishes almost immediately.
+// With VK_EXT_graphics_pipeline_library graphics pipelines can also be built from four separately compiled libraries,
+// which link in well under a millisecond when they already exist.
+class PipelineCompiler
+{
+public:
+	static constexpr std::array<VkGraphicsPipelineLibraryFlagBitsEXT, 4> s_LibraryParts = {
+		VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT
+	};
+	using LibraryFutures = std::array<std::shared_future<VkPipeline>, s_LibraryParts.size()>;
+
+	// pipelineLibraries requires graphicsPipelineLibrary and graphicsPipelineLibraryFastLinking on the device.
+	void Create(VkDevice device, VkPipelineCache cache, const VkAllocationCallbacks* allocator, uint32_t threadCount, bool pipelineLibraries);
+	// Waits for the compiles still queued. The pipelines belong to whoever asked for them.
+	void Destroy();
+
+	// The desc is copied, its shader modules, layout and render pass must stay alive until the future is ready.
+	std::shared_future<VkPipeline> Compile(const PipelineDesc& desc);
+	std::shared_future<VkPipeline> Compile(const ComputePipelineDesc& desc);
+
+	bool UsesPipelineLibraries() const { return m_PipelineLibraries; }
+	// One part of a graphics pipeline, compiled on its own. Only the state desc.ForLibrary(part) keeps is used.
+	std::shared_future<VkPipeline> CompileLibrary(const PipelineDesc& desc, VkGraphicsPipelineLibraryFlagBitsEXT part);
+	// Links a pipeline for desc from its four libraries, in s_LibraryParts order, once they are done. A fast link is
+	// ready almost at once, an optimized one takes about as long as a monolithic compile and runs faster on the GPU.
+	std::shared_future<VkPipeline> Link(const PipelineDesc& desc, const LibraryFutures& libraries, bool optimize);
+
+	// The pipeline if its compile has finished, VK_NULL_HANDLE otherwise. Rethrows if the compile failed.
+	static VkPipeline TryGet(const std::shared_future<VkPipeline>& future);
+
+	// Compiles queued or running.
+	uint32_t GetPendingCount() const { return m_PendingCount; }
+private:
+	template<typename F>
+	std::shared_future<VkPipeline> Submit(F&& job)
+	{
+		m_PendingCount++;
+		return m_Pool->Submit([this, job = std::forward<F>(job)]() {
+			try
+			{
+				VkPipeline pipeline = job();
+				m_PendingCount--;
+				return pipeline;
+			}
+			catch (...)
+			{
+				m_PendingCount--;
+				throw;
+			}
+		}).share();
+	}
+
+	// Builds the state of the given parts only. Libraries are created with flags including VK_PIPELINE_CREATE_LIBRARY_BIT_KHR,
+	// links with no parts and the libraries to link.
+	VkPipeline CreateGraphicsPipeline(const PipelineDesc& desc, VkGraphicsPipelineLibraryFlagsEXT parts, VkPipelineCreateFlags flags,
+		std::span<const VkPipeline> libraries) const;
+	VkPipeline CreateComputePipeline(const ComputePipelineDesc& desc) const;
+private:
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkPipelineCache m_Cache = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* m_Allocator = nullptr;
+	bool m_PipelineLibraries = false;
+	std::unique_ptr<ThreadPool> m_Pool;
+	std::atomic<uint32_t> m_PendingCount = 0;
+};
@@ -0,0 +1,189 @@
+#include "PipelineDesc.h"
+
+#include <functional>
+#include <stdexcept>
+
+template<typename T>
+static void HashCombine(size_t& seed, const T& value)
+{
+	seed ^= std::hash<T>{}(value) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+static bool operator==(const VkVertexInputBindingDescription& a, const VkVertexInputBindingDescription& b)
+{
+	return a.binding == b.binding && a.stride == b.stride && a.inputRate == b.inputRate;
+}
+
+static bool operator==(const VkVertexInputAttributeDescription& a, const VkVertexInputAttributeDescription& b)
+{
+	return a.location == b.location && a.binding == b.binding && a.format == b.format && a.offset == b.offset;
+}
+
+// Values outside mask stay 0 in dst.
+static void CopySpecializationConstants(PipelineDesc& dst, const PipelineDesc& src, uint32_t mask)
+{
+	dst.specializationMask = mask;
+	for (uint32_t i = 0; i < PipelineDesc::s_MaxSpecializationConstants; i++)
+		if (mask & (1u << i))
+			dst.specializationData[i] = src.specializationData[i];
+}
+
+void PipelineDesc::SetSpecializationConstant(uint32_t constantId, uint32_t value)
+{
+	if (constantId >= s_MaxSpecializationConstants)
+		throw std::runtime_error("Specialization constant id out of range!");
+
+	specializationMask |= 1u << constantId;
+	specializationData[constantId] = value;
+}
+
+bool PipelineDesc::operator==(const PipelineDesc& other) const
+{
+	if (specializationMask != other.specializationMask ||
+		vertexSpecializationIds != other.vertexSpecializationIds || fragmentSpecializationIds != other.fragmentSpecializationIds)
+		return false;
+	for (uint32_t i = 0; i < s_MaxSpecializationConstants; i++)
+		if ((specializationMask & (1u << i)) && specializationData[i] != other.specializationData[i])
+			return false;
+
+	if (vertexBindingCount != other.vertexBindingCount || vertexAttributeCount != other.vertexAttributeCount)
+		return false;
+	for (uint32_t i = 0; i < vertexBindingCount; i++)
+		if (!(vertexBindings[i] == other.vertexBindings[i]))
+			return false;
+	for (uint32_t i = 0; i < vertexAttributeCount; i++)
+		if (!(vertexAttributes[i] == other.vertexAttributes[i]))
+			return false;
+
+	return vertexShader == other.vertexShader && fragmentShader == other.fragmentShader && layout == other.layout &&
+		topology == other.topology &&
+		polygonMode == other.polygonMode && cullMode == other.cullMode && frontFace == other.frontFace && samples == other.samples &&
+		depthTest == other.depthTest && depthWrite == other.depthWrite && depthCompareOp == other.depthCompareOp &&
+		blendEnable == other.blendEnable &&
+		srcColorBlendFactor == other.srcColorBlendFactor && dstColorBlendFactor == other.dstColorBlendFactor && colorBlendOp == other.colorBlendOp &&
+		srcAlphaBlendFactor == other.srcAlphaBlendFactor && dstAlphaBlendFactor == other.dstAlphaBlendFactor && alphaBlendOp == other.alphaBlendOp &&
+		colorWriteMask == other.colorWriteMask &&
+		renderPass == other.renderPass && subpass == other.subpass && colorFormat == other.colorFormat && depthFormat == other.depthFormat;
+}
+
+size_t PipelineDesc::Hash() const
+{
+	size_t seed = 0;
+	HashCombine(seed, vertexShader);
+	HashCombine(seed, fragmentShader);
+	HashCombine(seed, layout);
+
+	HashCombine(seed, specializationMask);
+	HashCombine(seed, vertexSpecializationIds);
+	HashCombine(seed, fragmentSpecializationIds);
+	for (uint32_t i = 0; i < s_MaxSpecializationConstants; i++)
+		if (specializationMask & (1u << i))
+			HashCombine(seed, specializationData[i]);
+
+	HashCombine(seed, vertexBindingCount);
+	for (uint32_t i = 0; i < vertexBindingCount; i++)
+	{
+		HashCombine(seed, vertexBindings[i].binding);
+		HashCombine(seed, vertexBindings[i].stride);
+		HashCombine(seed, vertexBindings[i].inputRate);
+	}
+	HashCombine(seed, vertexAttributeCount);
+	for (uint32_t i = 0; i < vertexAttributeCount; i++)
+	{
+		HashCombine(seed, vertexAttributes[i].location);
+		HashCombine(seed, vertexAttributes[i].binding);
+		HashCombine(seed, vertexAttributes[i].format);
+		HashCombine(seed, vertexAttributes[i].offset);
+	}
+	HashCombine(seed, topology);
+
+	HashCombine(seed, polygonMode);
+	HashCombine(seed, cullMode);
+	HashCombine(seed, frontFace);
+	HashCombine(seed, samples);
+
+	HashCombine(seed, depthTest);
+	HashCombine(seed, depthWrite);
+	HashCombine(seed, depthCompareOp);
+
+	HashCombine(seed, blendEnable);
+	HashCombine(seed, srcColorBlendFactor);
+	HashCombine(seed, dstColorBlendFactor);
+	HashCombine(seed, colorBlendOp);
+	HashCombine(seed, srcAlphaBlendFactor);
+	HashCombine(seed, dstAlphaBlendFactor);
+	HashCombine(seed, alphaBlendOp);
+	HashCombine(seed, colorWriteMask);
+
+	HashCombine(seed, renderPass);
+	HashCombine(seed, subpass);
+	HashCombine(seed, colorFormat);
+	HashCombine(seed, depthFormat);
+	return seed;
+}
+
+PipelineDesc PipelineDesc::ForLibrary(VkGraphicsPipelineLibraryFlagBitsEXT part) const
+{
+	PipelineDesc desc{};
+	switch (part)
+	{
+	case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+		desc.vertexBindingCount = vertexBindingCount;
+		desc.vertexAttributeCount = vertexAttributeCount;
+		desc.vertexBindings = vertexBindings;
+		desc.vertexAttributes = vertexAttributes;
+		desc.topology = topology;
+		return desc;
+	case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+		desc.vertexShader = vertexShader;
+		desc.layout = layout;
+		desc.vertexSpecializationIds = vertexSpecializationIds;
+		CopySpecializationConstants(desc, *this, GetStageSpecializationMask(VK_SHADER_STAGE_VERTEX_BIT));
+		desc.polygonMode = polygonMode;
+		desc.cullMode = cullMode;
+		desc.frontFace = frontFace;
+		break;
+	case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+		desc.fragmentShader = fragmentShader;
+		desc.layout = layout;
+		desc.fragmentSpecializationIds = fragmentSpecializationIds;
+		CopySpecializationConstants(desc, *this, GetStageSpecializationMask(VK_SHADER_STAGE_FRAGMENT_BIT));
+		desc.samples = samples;
+		desc.depthTest = depthTest;
+		desc.depthWrite = depthWrite;
+		desc.depthCompareOp = depthCompareOp;
+		desc.colorFormat = colorFormat;
+		desc.depthFormat = depthFormat;
+		break;
+	case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT:
+		desc.samples = samples;
+		desc.blendEnable = blendEnable;
+		desc.srcColorBlendFactor = srcColorBlendFactor;
+		desc.dstColorBlendFactor = dstColorBlendFactor;
+		desc.colorBlendOp = colorBlendOp;
+		desc.srcAlphaBlendFactor = srcAlphaBlendFactor;
+		desc.dstAlphaBlendFactor = dstAlphaBlendFactor;
+		desc.alphaBlendOp = alphaBlendOp;
+		desc.colorWriteMask = colorWriteMask;
+		desc.colorFormat = colorFormat;
+		desc.depthFormat = depthFormat;
+		break;
+	default:
+		break;
+	}
+
+	// Everything past vertex input is built against the render pass.
+	desc.renderPass = renderPass;
+	desc.subpass = subpass;
+	return desc;
+}
+
+uint32_t PipelineDesc::GetStageSpecializationMask(VkShaderStageFlagBits stage) const
+{
+	switch (stage)
+	{
+	case VK_SHADER_STAGE_VERTEX_BIT: return specializationMask & vertexSpecializationIds;
+	case VK_SHADER_STAGE_FRAGMENT_BIT: return specializationMask & fragmentSpecializationIds;
+	default: return 0;
+	}
+}
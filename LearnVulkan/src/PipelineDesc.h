@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Everything a graphics pipeline is built from, as a small value that can be hashed and compared, so identical
+// descriptions can share one VkPipeline. Viewport and scissor are always dynamic and not part of it.
+struct PipelineDesc
+{
+	static constexpr uint32_t s_MaxVertexBindings = 4;
+	static constexpr uint32_t s_MaxVertexAttributes = 8;
+	static constexpr uint32_t s_MaxSpecializationConstants = 8;
+
+	// Shaders
+	VkShaderModule vertexShader = VK_NULL_HANDLE;
+	VkShaderModule fragmentShader = VK_NULL_HANDLE;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	// Values of the specialization constants with their bit set in specializationMask, indexed by constant_id. All values
+	// are 4 bytes (bools as VkBool32).
+	uint32_t specializationMask = 0;
+	std::array<uint32_t, s_MaxSpecializationConstants> specializationData{};
+	// Constant ids each shader declares, a stage only gets those. Keeps a constant of one stage from splitting the
+	// library parts of the other.
+	uint32_t vertexSpecializationIds = ~0u;
+	uint32_t fragmentSpecializationIds = ~0u;
+
+	// Vertex layout, only the first vertexBindingCount and vertexAttributeCount entries count.
+	uint32_t vertexBindingCount = 0;
+	uint32_t vertexAttributeCount = 0;
+	std::array<VkVertexInputBindingDescription, s_MaxVertexBindings> vertexBindings{};
+	std::array<VkVertexInputAttributeDescription, s_MaxVertexAttributes> vertexAttributes{};
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	// Rasterization
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+	// Depth
+	VkBool32 depthTest = VK_TRUE;
+	VkBool32 depthWrite = VK_TRUE;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+	// Blending of the single color attachment.
+	VkBool32 blendEnable = VK_FALSE;
+	VkBlendFactor srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	VkBlendFactor dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+	VkBlendOp colorBlendOp = VK_BLEND_OP_ADD;
+	VkBlendFactor srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	VkBlendFactor dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	VkBlendOp alphaBlendOp = VK_BLEND_OP_ADD;
+	VkColorComponentFlags colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	// Render targets. Without a render pass the formats are used for dynamic rendering, which the device then has to enable.
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+	VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+	// Throws if constantId is s_MaxSpecializationConstants or more.
+	void SetSpecializationConstant(uint32_t constantId, uint32_t value);
+
+	bool operator==(const PipelineDesc& other) const;
+	size_t Hash() const;
+
+	// Copy with only the state one part of a graphics pipeline library is built from, everything else at its default,
+	// so pipelines that differ elsewhere share that part.
+	PipelineDesc ForLibrary(VkGraphicsPipelineLibraryFlagBitsEXT part) const;
+	// Set constants the stage declares.
+	uint32_t GetStageSpecializationMask(VkShaderStageFlagBits stage) const;
+};
+
+struct PipelineDescHash
+{
+	size_t operator()(const PipelineDesc& desc) const { return desc.Hash(); }
+};
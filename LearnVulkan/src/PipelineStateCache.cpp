@@ -0,0 +1,156 @@
+#include "PipelineStateCache.h"
+
+#include <algorithm>
+#include <exception>
+
+void PipelineStateCache::Create(PipelineCompiler* compiler, VkDevice device, const VkAllocationCallbacks* allocator, DeletionQueue* deletionQueue)
+{
+	m_Compiler = compiler;
+	m_Device = device;
+	m_Allocator = allocator;
+	m_DeletionQueue = deletionQueue;
+}
+
+void PipelineStateCache::Destroy()
+{
+	for (auto& entry : m_Entries)
+	{
+		if (entry.pipeline != VK_NULL_HANDLE)
+			vkDestroyPipeline(m_Device, entry.pipeline, m_Allocator);
+		DestroyPipeline(entry.compiling);
+		DestroyPipeline(entry.optimizing);
+	}
+
+	// Linked pipelines don't reference their libraries, so the order doesn't matter.
+	for (auto& libraries : m_Libraries)
+	{
+		for (auto& [desc, library] : libraries)
+			DestroyPipeline(library);
+		libraries.clear();
+	}
+
+	m_Ids.clear();
+	m_Entries.clear();
+	m_Pending.clear();
+	m_Stats = {};
+}
+
+PipelineStateCache::PipelineId PipelineStateCache::GetOrCreate(const PipelineDesc& desc)
+{
+	auto it = m_Ids.find(desc);
+	if (it != m_Ids.end())
+	{
+		m_Stats.hits++;
+		return it->second;
+	}
+
+	m_Stats.misses++;
+	m_Stats.pipelineCount++;
+
+	Entry entry;
+	if (m_Compiler->UsesPipelineLibraries())
+	{
+		PipelineCompiler::LibraryFutures libraries;
+		for (size_t i = 0; i < libraries.size(); i++)
+			libraries[i] = GetOrCreateLibrary(desc, i);
+
+		entry.compiling = m_Compiler->Link(desc, libraries, false);
+		entry.optimizing = m_Compiler->Link(desc, libraries, true);
+	}
+	else
+		entry.compiling = m_Compiler->Compile(desc);
+
+	PipelineId id = static_cast<PipelineId>(m_Entries.size());
+	m_Entries.push_back(std::move(entry));
+	m_Ids.emplace(desc, id);
+	m_Pending.push_back(id);
+	return id;
+}
+
+void PipelineStateCache::Update()
+{
+	// A failed compile is rethrown once m_Pending is compacted, so the remaining entries are still picked up and a
+	// failed one is never looked at again.
+	std::exception_ptr failure;
+	auto done = std::remove_if(m_Pending.begin(), m_Pending.end(), [this, &failure](PipelineId id) {
+		Entry& entry = m_Entries[id];
+		if (entry.compiling.valid())
+		{
+			try
+			{
+				entry.pipeline = PipelineCompiler::TryGet(entry.compiling);
+			}
+			catch (...)
+			{
+				// An optimized link still running is left to Destroy().
+				entry.compiling = {};
+				if (!failure)
+					failure = std::current_exception();
+				return true;
+			}
+			if (entry.pipeline == VK_NULL_HANDLE)
+				return false;
+			entry.compiling = {};
+		}
+
+		if (entry.optimizing.valid())
+		{
+			VkPipeline optimized;
+			try
+			{
+				optimized = PipelineCompiler::TryGet(entry.optimizing);
+			}
+			catch (...)
+			{
+				// The fast-linked pipeline is only slower, keep drawing with it.
+				entry.optimizing = {};
+				m_Stats.optimizeFailedCount++;
+				return true;
+			}
+			if (optimized == VK_NULL_HANDLE)
+				return false;
+			entry.optimizing = {};
+
+			// Frames already submitted may still draw with the fast-linked pipeline.
+			m_DeletionQueue->Push([device = m_Device, allocator = m_Allocator, pipeline = entry.pipeline]() {
+				vkDestroyPipeline(device, pipeline, allocator);
+			});
+			entry.pipeline = optimized;
+			m_Stats.optimizedCount++;
+		}
+		return true;
+	});
+	m_Pending.erase(done, m_Pending.end());
+
+	if (failure)
+		std::rethrow_exception(failure);
+}
+
+std::shared_future<VkPipeline> PipelineStateCache::GetOrCreateLibrary(const PipelineDesc& desc, size_t partIndex)
+{
+	VkGraphicsPipelineLibraryFlagBitsEXT part = PipelineCompiler::s_LibraryParts[partIndex];
+	PipelineDesc partDesc = desc.ForLibrary(part);
+
+	auto& libraries = m_Libraries[partIndex];
+	auto it = libraries.find(partDesc);
+	if (it != libraries.end())
+		return it->second;
+
+	m_Stats.libraryCount++;
+	return libraries.emplace(partDesc, m_Compiler->CompileLibrary(desc, part)).first->second;
+}
+
+void PipelineStateCache::DestroyPipeline(const std::shared_future<VkPipeline>& future)
+{
+	if (!future.valid())
+		return;
+
+	// A failed compile has nothing to destroy, it was already reported to whoever waited for it.
+	try
+	{
+		vkDestroyPipeline(m_Device, future.get(), m_Allocator);
+	}
+	catch (...)
+	{
+	}
+}
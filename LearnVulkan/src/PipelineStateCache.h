@@ -0,0 +1,73 @@
+#pragma once
+
+#include "DeletionQueue.h"
+#include "PipelineCompiler.h"
+#include "PipelineDesc.h"
+
+#include <array>
+#include <cstdint>
+#include <future>
+#include <unordered_map>
+#include <vector>
+
+struct PipelineStateCacheStats
+{
+	// Distinct pipelines built or being built, and the libraries they were linked from.
+	uint32_t pipelineCount = 0;
+	uint32_t libraryCount = 0;
+	// Requests answered with an existing pipeline, compiled or still compiling, and requests that started a compile.
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	// Fast-linked pipelines replaced by their optimized link, and ones kept because the optimized link failed.
+	uint32_t optimizedCount = 0;
+	uint32_t optimizeFailedCount = 0;
+};
+
+// Hands out one pipeline per distinct PipelineDesc, so materials sharing state share the VkPipeline too.
+// A desc seen before gets the id of the first request, also while that compile is still running.
+// With pipeline libraries every pipeline is first fast-linked from libraries that are themselves shared between
+// descs, then relinked with link time optimization in the background. Update() swaps the optimized pipeline in and hands
+// the fast-linked one to the deletion queue.
+// Owns the pipelines and libraries, they live until Destroy(). Render thread only.
+class PipelineStateCache
+{
+public:
+	using PipelineId = uint32_t;
+
+	void Create(PipelineCompiler* compiler, VkDevice device, const VkAllocationCallbacks* allocator, DeletionQueue* deletionQueue);
+	// Waits for compiles still running and destroys every pipeline and library. The GPU must be done with them.
+	void Destroy();
+
+	PipelineId GetOrCreate(const PipelineDesc& desc);
+	// The best version of the pipeline picked up by the last Update(), VK_NULL_HANDLE while none is ready.
+	VkPipeline Get(PipelineId id) const { return m_Entries[id].pipeline; }
+
+	// Picks up finished compiles. Call once per frame, before recording. Rethrows the first failed compile once the other
+	// entries are picked up. A failed optimized link is not an error, the fast-linked pipeline stays in use.
+	void Update();
+
+	const PipelineStateCacheStats& GetStats() const { return m_Stats; }
+private:
+	struct Entry
+	{
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		// Valid until Update() has picked them up.
+		std::shared_future<VkPipeline> compiling;
+		std::shared_future<VkPipeline> optimizing;
+	};
+private:
+	std::shared_future<VkPipeline> GetOrCreateLibrary(const PipelineDesc& desc, size_t partIndex);
+	void DestroyPipeline(const std::shared_future<VkPipeline>& future);
+private:
+	PipelineCompiler* m_Compiler = nullptr;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* m_Allocator = nullptr;
+	DeletionQueue* m_DeletionQueue = nullptr;
+	std::unordered_map<PipelineDesc, PipelineId, PipelineDescHash> m_Ids;
+	std::vector<Entry> m_Entries;
+	// Entries with a compile Update() still has to pick up.
+	std::vector<PipelineId> m_Pending;
+	// Keyed by the desc reduced to the part's state, indexed like PipelineCompiler::s_LibraryParts.
+	std::array<std::unordered_map<PipelineDesc, std::shared_future<VkPipeline>, PipelineDescHash>, PipelineCompiler::s_LibraryParts.size()> m_Libraries;
+	PipelineStateCacheStats m_Stats;
+};
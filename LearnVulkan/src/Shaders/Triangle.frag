@@ -1,9 +1,19 @@
 #version 450
 
+// Specialization constants, the ids match TriangleConstant in Triangle.h.
+layout(constant_id = 1) const bool MONOCHROME = false;
+// Color steps per channel, 0 keeps the full gradient.
+layout(constant_id = 2) const uint COLOR_LEVELS = 0;
+
 layout(location = 0) in vec3 fragColor;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    vec3 color = fragColor;
+    if (COLOR_LEVELS > 0)
+        color = floor(color * float(COLOR_LEVELS)) / float(COLOR_LEVELS);
+    if (MONOCHROME)
+        color = vec3(dot(color, vec3(0.2126, 0.7152, 0.0722)));
+    outColor = vec4(color, 1.0);
 }
\ No newline at end of file
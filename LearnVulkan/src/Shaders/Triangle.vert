@@ -1,5 +1,14 @@
 #version 450
 
+// Specialization constants, the ids match TriangleConstant in Triangle.h. Every variant is built from this one module,
+// the driver folds the branches on them away when the pipeline is created.
+layout(constant_id = 0) const bool VERTEX_COLORS = true;
+
+layout(set = 0, binding = 0) uniform DrawConstants {
+    vec2 offset;
+    float scale;
+} draw;
+
 layout(location = 0) out vec3 fragColor;
 
 vec2 positions[3] = vec2[](
@@ -15,6 +24,6 @@ vec3 colors[3] = vec3[](
 );
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
-}
\ No newline at end of file
+    gl_Position = vec4(positions[gl_VertexIndex] * draw.scale + draw.offset, 0.0, 1.0);
+    fragColor = VERTEX_COLORS ? colors[gl_VertexIndex] : vec3(1.0);
+}
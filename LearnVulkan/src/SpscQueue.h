@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <optional>
+
+// Lock-free bounded queue for exactly one producer thread and one consumer thread.
+// Capacity must be a power of two, one slot is kept free to tell a full queue from an empty one.
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+public:
+	// Producer side. Returns false if the queue is full.
+	bool TryPush(const T& value)
+	{
+		size_t head = m_Head.load(std::memory_order_relaxed);
+		size_t next = (head + 1) & (Capacity - 1);
+		if (next == m_Tail.load(std::memory_order_acquire))
+			return false;
+
+		m_Items[head] = value;
+		m_Head.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side. Returns nothing if the queue is empty.
+	std::optional<T> TryPop()
+	{
+		size_t tail = m_Tail.load(std::memory_order_relaxed);
+		if (tail == m_Head.load(std::memory_order_acquire))
+			return std::nullopt;
+
+		T value = m_Items[tail];
+		m_Tail.store((tail + 1) & (Capacity - 1), std::memory_order_release);
+		return value;
+	}
+private:
+	// Keep the indices on separate cache lines so the two threads don't keep stealing the line from each other.
+	static constexpr size_t s_CacheLineSize = 64;
+	alignas(s_CacheLineSize) std::atomic<size_t> m_Head{ 0 };
+	alignas(s_CacheLineSize) std::atomic<size_t> m_Tail{ 0 };
+	alignas(s_CacheLineSize) std::array<T, Capacity> m_Items{};
+};
@@ -0,0 +1,109 @@
+#include "StagingBelt.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void StagingBelt::Create(DeviceAllocator* allocator, HostAllocator* hostAllocator, VkDevice device, VkDeviceSize blockSize)
+{
+	m_Allocator = allocator;
+	m_HostAllocator = hostAllocator;
+	m_Device = device;
+	m_BlockSize = blockSize;
+}
+
+void StagingBelt::Destroy()
+{
+	for (auto& block : m_Active)
+		DestroyBlock(block);
+	for (auto& block : m_InFlight)
+		DestroyBlock(block);
+	for (auto& block : m_Free)
+		DestroyBlock(block);
+
+	m_Active.clear();
+	m_InFlight.clear();
+	m_Free.clear();
+}
+
+StagingRange StagingBelt::Allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	// Only the newest active block is filled, older ones are left with whatever didn't fit.
+	Block* block = m_Active.empty() ? nullptr : &m_Active.back();
+	VkDeviceSize offset = block ? (block->head + alignment - 1) / alignment * alignment : 0;
+
+	if (block == nullptr || offset + size > block->size)
+	{
+		if (size <= m_BlockSize && !m_Free.empty())
+		{
+			m_Active.push_back(m_Free.back());
+			m_Free.pop_back();
+		}
+		else
+			m_Active.push_back(CreateBlock(std::max(size, m_BlockSize)));
+
+		block = &m_Active.back();
+		block->head = 0;
+		offset = 0;
+	}
+
+	block->head = offset + size;
+
+	StagingRange range;
+	range.buffer = block->buffer;
+	range.offset = offset;
+	range.data = static_cast<char*>(block->allocation->mapped) + offset;
+	return range;
+}
+
+void StagingBelt::Retire(uint64_t value)
+{
+	for (auto& block : m_Active)
+	{
+		block.retireValue = value;
+		m_InFlight.push_back(block);
+	}
+	m_Active.clear();
+}
+
+void StagingBelt::Reclaim(uint64_t completedValue)
+{
+	while (!m_InFlight.empty() && m_InFlight.front().retireValue <= completedValue)
+	{
+		Block& block = m_InFlight.front();
+		if (block.size == m_BlockSize)
+			m_Free.push_back(block);
+		else
+			DestroyBlock(block);
+		m_InFlight.pop_front();
+	}
+}
+
+StagingBelt::Block StagingBelt::CreateBlock(VkDeviceSize size)
+{
+	Block block;
+	block.size = size;
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(m_Device, &bufferInfo, m_HostAllocator->Get(VK_OBJECT_TYPE_BUFFER), &block.buffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create staging buffer!");
+
+	block.allocation = m_Allocator->AllocateBuffer(block.buffer, MemoryUsage::CpuToGpu);
+
+	m_BlockCount++;
+	m_ReservedBytes += size;
+	return block;
+}
+
+void StagingBelt::DestroyBlock(Block& block)
+{
+	vkDestroyBuffer(m_Device, block.buffer, m_HostAllocator->Get(VK_OBJECT_TYPE_BUFFER));
+	m_Allocator->Free(block.allocation);
+
+	m_BlockCount--;
+	m_ReservedBytes -= block.size;
+}
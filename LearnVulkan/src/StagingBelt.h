@@ -0,0 +1,57 @@
+#pragma once
+
+#include "DeviceAllocator.h"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// A range of a staging block to write upload data into.
+struct StagingRange
+{
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	void* data = nullptr;
+};
+
+// Hands out staging memory from large, persistently mapped blocks that are reused instead of created per upload.
+// Blocks written since the last Retire() go back to the free list once the GPU has passed the timeline value they
+// were retired with. Uploads larger than a block get a block of their own, which is freed instead of kept.
+class StagingBelt
+{
+public:
+	void Create(DeviceAllocator* allocator, HostAllocator* hostAllocator, VkDevice device, VkDeviceSize blockSize);
+	void Destroy();
+
+	StagingRange Allocate(VkDeviceSize size, VkDeviceSize alignment);
+	// Every block written since the last call is in use until the GPU passes value.
+	void Retire(uint64_t value);
+	// Recycles the blocks of every retired value up to completedValue.
+	void Reclaim(uint64_t completedValue);
+
+	uint32_t GetBlockCount() const { return m_BlockCount; }
+	VkDeviceSize GetReservedBytes() const { return m_ReservedBytes; }
+private:
+	struct Block
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		Allocation* allocation = nullptr;
+		VkDeviceSize size = 0;
+		VkDeviceSize head = 0;
+		uint64_t retireValue = 0;
+	};
+private:
+	Block CreateBlock(VkDeviceSize size);
+	void DestroyBlock(Block& block);
+private:
+	DeviceAllocator* m_Allocator = nullptr;
+	HostAllocator* m_HostAllocator = nullptr;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkDeviceSize m_BlockSize = 0;
+	// Blocks being written, blocks waiting for the GPU in retire order, and blocks ready for reuse.
+	std::vector<Block> m_Active;
+	std::deque<Block> m_InFlight;
+	std::vector<Block> m_Free;
+	uint32_t m_BlockCount = 0;
+	VkDeviceSize m_ReservedBytes = 0;
+};
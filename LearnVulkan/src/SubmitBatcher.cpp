@@ -0,0 +1,155 @@
+#include "SubmitBatcher.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void SubmitBatcher::Add(VkQueue queue, std::span<const VkCommandBuffer> commandBuffers,
+	std::span<const VkSemaphoreSubmitInfo> waits, std::span<const VkSemaphoreSubmitInfo> signals, Timeline* timeline)
+{
+	auto timelineSignal = std::find_if(signals.begin(), signals.end(), [timeline](const VkSemaphoreSubmitInfo& signal) {
+		return timeline != nullptr && signal.semaphore == timeline->GetSemaphore();
+	});
+	if (timeline != nullptr && timelineSignal == signals.end())
+		throw std::runtime_error("Submission does not signal its timeline!");
+
+	Submission& submission = m_Pending.emplace_back();
+	submission.queue = queue;
+	submission.timeline = timeline;
+	submission.timelineValue = timeline != nullptr ? timelineSignal->value : 0;
+
+	submission.firstWait = static_cast<uint32_t>(m_Waits.size());
+	submission.waitCount = static_cast<uint32_t>(waits.size());
+	m_Waits.insert(m_Waits.end(), waits.begin(), waits.end());
+
+	submission.firstCommandBuffer = static_cast<uint32_t>(m_CommandBuffers.size());
+	submission.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+	for (VkCommandBuffer commandBuffer : commandBuffers)
+	{
+		VkCommandBufferSubmitInfo commandBufferInfo{};
+		commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+		commandBufferInfo.commandBuffer = commandBuffer;
+		m_CommandBuffers.push_back(commandBufferInfo);
+	}
+
+	submission.firstSignal = static_cast<uint32_t>(m_Signals.size());
+	submission.signalCount = static_cast<uint32_t>(signals.size());
+	m_Signals.insert(m_Signals.end(), signals.begin(), signals.end());
+
+	if (std::find(m_Queues.begin(), m_Queues.end(), queue) == m_Queues.end())
+		m_Queues.push_back(queue);
+}
+
+uint32_t SubmitBatcher::Flush()
+{
+	// Clears even if a submit throws, queues submitted before the failure must not be submitted again by the next flush.
+	struct ClearOnExit
+	{
+		SubmitBatcher* batcher;
+		~ClearOnExit() { batcher->Clear(); }
+	} clearOnExit{ this };
+
+	uint32_t submitCalls = 0;
+	for (VkQueue queue : m_Queues)
+	{
+		OrderSubmissions(queue);
+
+		m_SubmitInfos.clear();
+		for (uint32_t index : m_Order)
+		{
+			const Submission& submission = m_Pending[index];
+
+			VkSubmitInfo2 submitInfo{};
+			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+			submitInfo.waitSemaphoreInfoCount = submission.waitCount;
+			submitInfo.pWaitSemaphoreInfos = m_Waits.data() + submission.firstWait;
+			submitInfo.commandBufferInfoCount = submission.commandBufferCount;
+			submitInfo.pCommandBufferInfos = m_CommandBuffers.data() + submission.firstCommandBuffer;
+			submitInfo.signalSemaphoreInfoCount = submission.signalCount;
+			submitInfo.pSignalSemaphoreInfos = m_Signals.data() + submission.firstSignal;
+			m_SubmitInfos.push_back(submitInfo);
+		}
+
+		if (vkQueueSubmit2(queue, static_cast<uint32_t>(m_SubmitInfos.size()), m_SubmitInfos.data(), VK_NULL_HANDLE) != VK_SUCCESS)
+			throw std::runtime_error("Failed to submit command buffers!");
+
+		for (uint32_t index : m_Order)
+		{
+			if (m_Pending[index].timeline != nullptr)
+				m_Pending[index].timeline->MarkSubmitted(m_Pending[index].timelineValue);
+		}
+
+		submitCalls++;
+		m_SubmitCalls++;
+		m_Submissions += static_cast<uint32_t>(m_Order.size());
+	}
+
+	return submitCalls;
+}
+
+void SubmitBatcher::OrderSubmissions(VkQueue queue)
+{
+	m_Order.clear();
+	m_Ordered.assign(m_Pending.size(), false);
+
+	size_t remaining = std::count_if(m_Pending.begin(), m_Pending.end(), [queue](const Submission& submission) {
+		return submission.queue == queue;
+	});
+	while (remaining > 0)
+	{
+		// Each pass takes everything that no longer waits on a later submission, keeping the order among them.
+		size_t ordered = m_Order.size();
+		for (uint32_t index = 0; index < m_Pending.size(); index++)
+		{
+			if (m_Pending[index].queue != queue || m_Ordered[index] || WaitsOnUnordered(m_Pending[index], queue))
+				continue;
+
+			m_Order.push_back(index);
+			m_Ordered[index] = true;
+			remaining--;
+		}
+
+		if (m_Order.size() == ordered)
+			throw std::runtime_error("Submissions to the same queue wait on each other!");
+	}
+}
+
+bool SubmitBatcher::WaitsOnUnordered(const Submission& submission, VkQueue queue) const
+{
+	for (uint32_t wait = submission.firstWait; wait < submission.firstWait + submission.waitCount; wait++)
+	{
+		for (uint32_t index = 0; index < m_Pending.size(); index++)
+		{
+			const Submission& other = m_Pending[index];
+			if (&other == &submission || other.queue != queue || m_Ordered[index])
+				continue;
+
+			// Binary semaphores have a value of 0 on both sides, so this matches them as well.
+			for (uint32_t signal = other.firstSignal; signal < other.firstSignal + other.signalCount; signal++)
+			{
+				if (m_Signals[signal].semaphore == m_Waits[wait].semaphore && m_Signals[signal].value >= m_Waits[wait].value)
+					return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void SubmitBatcher::Clear()
+{
+	m_Pending.clear();
+	m_Waits.clear();
+	m_Signals.clear();
+	m_CommandBuffers.clear();
+	m_Queues.clear();
+}
+
+VkSemaphoreSubmitInfo SubmitBatcher::SemaphoreInfo(VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags2 stageMask)
+{
+	VkSemaphoreSubmitInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	semaphoreInfo.semaphore = semaphore;
+	semaphoreInfo.value = value;
+	semaphoreInfo.stageMask = stageMask;
+	return semaphoreInfo;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Timeline.h"
+
+#include <span>
+#include <vector>
+
+// Collects the submissions of every subsystem during a frame and flushes them with one vkQueueSubmit2 call per queue,
+// instead of paying a kernel transition for every small submit.
+// Submissions to the same queue keep their order, except that one waiting for a semaphore a later submission to the
+// same queue signals is moved behind it, since a queue never starts work queued after a blocked submission. That
+// happens when two subsystems share a queue, e.g. compute falling back to the graphics queue. Queues are flushed in
+// the order they were first used, which is all binary semaphores need as long as a binary signal is added before its
+// wait. Timeline waits may be added before their signals in any order. Like the queues it feeds, a batcher must only
+// be used by one thread.
+class SubmitBatcher
+{
+public:
+	// Everything is copied, the arrays only have to live until the call returns. If timeline is given, one of the
+	// signals must be on its semaphore, and Flush() marks that value submitted.
+	void Add(VkQueue queue, std::span<const VkCommandBuffer> commandBuffers,
+		std::span<const VkSemaphoreSubmitInfo> waits, std::span<const VkSemaphoreSubmitInfo> signals, Timeline* timeline = nullptr);
+	// Submits everything added since the last flush. Returns the number of vkQueueSubmit2 calls made.
+	// If a submit fails, everything not yet submitted is dropped along with the error, nothing is submitted twice.
+	uint32_t Flush();
+
+	// Counters since the last ResetStats(), to be read once per frame.
+	uint32_t GetSubmitCalls() const { return m_SubmitCalls; }
+	uint32_t GetSubmissions() const { return m_Submissions; }
+	void ResetStats() { m_SubmitCalls = 0; m_Submissions = 0; }
+
+	static VkSemaphoreSubmitInfo SemaphoreInfo(VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags2 stageMask);
+	static VkSemaphoreSubmitInfo SemaphoreInfo(const TimelineWait& wait) { return SemaphoreInfo(wait.semaphore, wait.value, wait.stageMask); }
+private:
+	struct Submission
+	{
+		VkQueue queue;
+		uint32_t firstWait, waitCount;
+		uint32_t firstCommandBuffer, commandBufferCount;
+		uint32_t firstSignal, signalCount;
+		Timeline* timeline;
+		uint64_t timelineValue;
+	};
+private:
+	// Fills m_Order with the submissions to queue, each after the ones signaling what it waits for.
+	void OrderSubmissions(VkQueue queue);
+	bool WaitsOnUnordered(const Submission& submission, VkQueue queue) const;
+	void Clear();
+private:
+	// Flat storage for all submissions, reused across flushes so a steady frame loop doesn't allocate.
+	std::vector<Submission> m_Pending;
+	std::vector<VkSemaphoreSubmitInfo> m_Waits, m_Signals;
+	std::vector<VkCommandBufferSubmitInfo> m_CommandBuffers;
+	std::vector<VkQueue> m_Queues;
+	std::vector<VkSubmitInfo2> m_SubmitInfos;
+	std::vector<uint32_t> m_Order;
+	std::vector<bool> m_Ordered;
+	uint32_t m_SubmitCalls = 0;
+	uint32_t m_Submissions = 0;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads that run submitted jobs in FIFO order.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(uint32_t threadCount);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Queues a job and returns a future for its result. Exceptions thrown by the job are rethrown by future::get().
+	template<typename F>
+	auto Submit(F&& job) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+	{
+		using Result = std::invoke_result_t<std::decay_t<F>>;
+
+		// std::function needs a copyable target, so the move-only task is shared.
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+		std::future<Result> result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Jobs.emplace([task]() { (*task)(); });
+		}
+		m_Condition.notify_one();
+		return result;
+	}
+
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Threads.size()); }
+private:
+	void WorkerLoop();
+private:
+	std::vector<std::thread> m_Threads;
+	std::queue<std::function<void()>> m_Jobs;
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	bool m_Stopping = false;
+};
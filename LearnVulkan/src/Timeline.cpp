@@ -0,0 +1,95 @@
+#include "Timeline.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void Timeline::Create(HostAllocator* hostAllocator, VkDevice device)
+{
+	m_HostAllocator = hostAllocator;
+	m_Device = device;
+
+	VkSemaphoreTypeCreateInfo typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+
+	if (vkCreateSemaphore(m_Device, &semaphoreInfo, m_HostAllocator->Get(VK_OBJECT_TYPE_SEMAPHORE), &m_Semaphore) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create timeline semaphore!");
+
+	m_LastReserved = 0;
+	m_LastSubmitted = 0;
+	m_Completed = 0;
+}
+
+void Timeline::Destroy()
+{
+	vkDestroySemaphore(m_Device, m_Semaphore, m_HostAllocator->Get(VK_OBJECT_TYPE_SEMAPHORE));
+	m_Semaphore = VK_NULL_HANDLE;
+}
+
+uint64_t Timeline::Next()
+{
+	return m_LastReserved.fetch_add(1, std::memory_order_acq_rel) + 1;
+}
+
+void Timeline::MarkSubmitted(uint64_t value)
+{
+	// Only the submitting thread writes, a plain store is enough.
+	if (value > m_LastSubmitted.load(std::memory_order_relaxed))
+		m_LastSubmitted.store(value, std::memory_order_release);
+}
+
+uint64_t Timeline::GetCompleted()
+{
+	uint64_t value = 0;
+	if (vkGetSemaphoreCounterValue(m_Device, m_Semaphore, &value) != VK_SUCCESS)
+		throw std::runtime_error("Failed to query timeline semaphore!");
+
+	return UpdateCompleted(value);
+}
+
+bool Timeline::HasPassed(uint64_t value)
+{
+	if (value <= m_Completed.load(std::memory_order_acquire))
+		return true;
+
+	return value <= GetCompleted();
+}
+
+bool Timeline::Wait(uint64_t value, uint64_t timeout)
+{
+	if (HasPassed(value))
+		return true;
+
+	// A value that is only reserved may never reach the GPU, waiting for it could block forever.
+	if (value > GetLastSubmitted())
+		throw std::runtime_error("Waiting for a timeline value that was never submitted!");
+
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &m_Semaphore;
+	waitInfo.pValues = &value;
+
+	VkResult result = vkWaitSemaphores(m_Device, &waitInfo, timeout);
+	if (result == VK_TIMEOUT)
+		return false;
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to wait for timeline semaphore!");
+
+	UpdateCompleted(value);
+	return true;
+}
+
+uint64_t Timeline::UpdateCompleted(uint64_t value)
+{
+	// Another thread may have observed a newer value in the meantime, never move the cache backwards.
+	uint64_t cached = m_Completed.load(std::memory_order_relaxed);
+	while (cached < value && !m_Completed.compare_exchange_weak(cached, value, std::memory_order_acq_rel));
+
+	return std::max(cached, value);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "HostAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstdint>
+
+// A point on some queue's timeline that a submission has to wait for before stageMask may start.
+struct TimelineWait
+{
+	VkSemaphore semaphore;
+	uint64_t value;
+	VkPipelineStageFlags2 stageMask;
+};
+
+// Tracks GPU progress on one queue with a timeline semaphore. Every submission signals a new, strictly increasing
+// value, so CPU waits, resource reuse and other queues only ever need to ask "has the GPU passed value X?".
+// Values must be reserved and submitted in the same order, so only one thread should submit against a timeline.
+class Timeline
+{
+public:
+	void Create(HostAllocator* hostAllocator, VkDevice device);
+	void Destroy();
+
+	// Reserves the value the next submission will signal. It only counts as submitted once MarkSubmitted() is called,
+	// which SubmitBatcher::Flush() does after handing it to the queue.
+	uint64_t Next();
+	void MarkSubmitted(uint64_t value);
+	// Value of the most recent reservation. Work recorded so far signals at most this value.
+	uint64_t GetLastReserved() const { return m_LastReserved.load(std::memory_order_acquire); }
+	// Value of the most recent submission that reached the queue. Once it has passed, all submitted work is done.
+	uint64_t GetLastSubmitted() const { return m_LastSubmitted.load(std::memory_order_acquire); }
+	// Latest value the GPU has reached.
+	uint64_t GetCompleted();
+	bool HasPassed(uint64_t value);
+	// Blocks until the GPU has reached value, which must have been submitted. Returns false if the timeout expired first.
+	bool Wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+
+	VkSemaphore GetSemaphore() const { return m_Semaphore; }
+	TimelineWait WaitFor(uint64_t value, VkPipelineStageFlags2 stageMask) const { return { m_Semaphore, value, stageMask }; }
+private:
+	uint64_t UpdateCompleted(uint64_t value);
+private:
+	HostAllocator* m_HostAllocator = nullptr;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkSemaphore m_Semaphore = VK_NULL_HANDLE;
+	std::atomic<uint64_t> m_LastReserved{ 0 };
+	std::atomic<uint64_t> m_LastSubmitted{ 0 };
+	// Cached so that HasPassed() does not have to call into the driver for values we already know are done.
+	std::atomic<uint64_t> m_Completed{ 0 };
+};
@@ -0,0 +1,185 @@
+#include "TransientImagePool.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+static bool PassesOverlap(const TransientImageDesc& a, const TransientImageDesc& b)
+{
+	return a.firstPass <= b.lastPass && b.firstPass <= a.lastPass;
+}
+
+static bool RangesOverlap(VkDeviceSize offsetA, VkDeviceSize sizeA, VkDeviceSize offsetB, VkDeviceSize sizeB)
+{
+	return offsetA < offsetB + sizeB && offsetB < offsetA + sizeA;
+}
+
+void TransientImagePool::Create(DeviceAllocator* allocator, HostAllocator* hostAllocator, VkDevice device)
+{
+	m_Allocator = allocator;
+	m_HostAllocator = hostAllocator;
+	m_Device = device;
+}
+
+void TransientImagePool::Destroy()
+{
+	for (auto& image : m_Images)
+	{
+		vkDestroyImageView(m_Device, image.view, m_HostAllocator->Get(VK_OBJECT_TYPE_IMAGE_VIEW));
+		vkDestroyImage(m_Device, image.image, m_HostAllocator->Get(VK_OBJECT_TYPE_IMAGE));
+	}
+	m_Images.clear();
+
+	m_Allocator->Free(m_Allocation);
+	m_Allocation = nullptr;
+	m_AliasedSize = 0;
+	m_UnaliasedSize = 0;
+}
+
+TransientImagePool::ImageId TransientImagePool::AddImage(const TransientImageDesc& desc)
+{
+	if (m_Allocation != nullptr)
+		throw std::runtime_error("Transient images must be added before the pool is built!");
+
+	Image& image = m_Images.emplace_back();
+	image.desc = desc;
+	// Aliases start out in an undefined layout anyway.
+	image.desc.createInfo.flags |= VK_IMAGE_CREATE_ALIAS_BIT;
+	image.desc.createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	if (vkCreateImage(m_Device, &image.desc.createInfo, m_HostAllocator->Get(VK_OBJECT_TYPE_IMAGE), &image.image) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create transient image!");
+	vkGetImageMemoryRequirements(m_Device, image.image, &image.requirements);
+
+	return static_cast<ImageId>(m_Images.size() - 1);
+}
+
+void TransientImagePool::Build()
+{
+	if (m_Images.empty())
+		return;
+
+	VkMemoryRequirements requirements{};
+	requirements.memoryTypeBits = ~0u;
+	requirements.alignment = 1;
+	for (const auto& image : m_Images)
+	{
+		requirements.memoryTypeBits &= image.requirements.memoryTypeBits;
+		requirements.alignment = std::max(requirements.alignment, image.requirements.alignment);
+		m_UnaliasedSize += image.requirements.size;
+	}
+
+	if (requirements.memoryTypeBits == 0)
+		throw std::runtime_error("Transient images have no memory type in common!");
+
+	// Largest first, so the small ones fill the gaps the large ones leave.
+	std::vector<ImageId> order(m_Images.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [this](ImageId a, ImageId b) {
+		return m_Images[a].requirements.size > m_Images[b].requirements.size;
+	});
+
+	std::vector<ImageId> placed;
+	for (ImageId id : order)
+	{
+		Image& image = m_Images[id];
+
+		// The lowest free offset is either 0 or right behind an image alive at the same time.
+		std::vector<VkDeviceSize> candidates = { 0 };
+		for (ImageId other : placed)
+			if (PassesOverlap(image.desc, m_Images[other].desc))
+				candidates.push_back(m_Images[other].offset + m_Images[other].requirements.size);
+		std::sort(candidates.begin(), candidates.end());
+
+		for (VkDeviceSize candidate : candidates)
+		{
+			VkDeviceSize offset = (candidate + requirements.alignment - 1) / requirements.alignment * requirements.alignment;
+			bool fits = std::none_of(placed.begin(), placed.end(), [&](ImageId other) {
+				const Image& placedImage = m_Images[other];
+				return PassesOverlap(image.desc, placedImage.desc)
+					&& RangesOverlap(offset, image.requirements.size, placedImage.offset, placedImage.requirements.size);
+			});
+
+			if (fits)
+			{
+				image.offset = offset;
+				break;
+			}
+		}
+
+		placed.push_back(id);
+		m_AliasedSize = std::max(m_AliasedSize, image.offset + image.requirements.size);
+	}
+
+	for (ImageId id = 0; id < m_Images.size(); id++)
+		for (ImageId other = 0; other < m_Images.size(); other++)
+			if (other != id && RangesOverlap(m_Images[id].offset, m_Images[id].requirements.size, m_Images[other].offset, m_Images[other].requirements.size))
+				m_Images[id].aliases.push_back(other);
+
+	requirements.size = m_AliasedSize;
+	m_Allocation = m_Allocator->AllocateMemory(requirements, MemoryUsage::GpuOnly);
+
+	for (auto& image : m_Images)
+	{
+		if (vkBindImageMemory(m_Device, image.image, m_Allocation->memory, m_Allocation->offset + image.offset) != VK_SUCCESS)
+			throw std::runtime_error("Failed to bind transient image memory!");
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = image.desc.createInfo.format;
+		viewInfo.subresourceRange.aspectMask = image.desc.aspectMask;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = image.desc.createInfo.mipLevels;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = image.desc.createInfo.arrayLayers;
+
+		if (vkCreateImageView(m_Device, &viewInfo, m_HostAllocator->Get(VK_OBJECT_TYPE_IMAGE_VIEW), &image.view) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create transient image view!");
+	}
+}
+
+void TransientImagePool::RecordBarriers(VkCommandBuffer commandBuffer, uint32_t pass) const
+{
+	std::vector<VkImageMemoryBarrier> barriers;
+	VkPipelineStageFlags srcStageMask = 0, dstStageMask = 0;
+	for (const auto& image : m_Images)
+	{
+		if (image.desc.firstPass != pass)
+			continue;
+
+		// The previous owners of the memory, earlier in this frame or in the previous one, have to finish first.
+		// Without aliases the image still waits for its own use in the previous frame.
+		VkAccessFlags srcAccessMask = image.desc.accessMask;
+		srcStageMask |= image.desc.stageMask;
+		for (ImageId alias : image.aliases)
+		{
+			srcAccessMask |= m_Images[alias].desc.accessMask;
+			srcStageMask |= m_Images[alias].desc.stageMask;
+		}
+
+		VkImageMemoryBarrier& barrier = barriers.emplace_back();
+		barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccessMask;
+		barrier.dstAccessMask = image.desc.accessMask;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = image.desc.layout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image.image;
+		barrier.subresourceRange.aspectMask = image.desc.aspectMask;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = image.desc.createInfo.mipLevels;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = image.desc.createInfo.arrayLayers;
+		dstStageMask |= image.desc.stageMask;
+	}
+
+	if (barriers.empty())
+		return;
+
+	vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 0, nullptr, 0, nullptr,
+		static_cast<uint32_t>(barriers.size()), barriers.data());
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "DeviceAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// What a transient image is and which passes of the frame use it, passes are numbered in recording order.
+struct TransientImageDesc
+{
+	VkImageCreateInfo createInfo{};
+	VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	uint32_t firstPass = 0;
+	uint32_t lastPass = 0;
+	// Layout the first pass expects, and every stage and access of the image across its passes.
+	VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VkPipelineStageFlags stageMask = 0;
+	VkAccessFlags accessMask = 0;
+};
+
+// Render targets that only live for part of a frame. Images whose pass ranges don't overlap share memory: Build()
+// places them in one allocation, largest first, each at the lowest offset no image alive at the same time occupies,
+// and binds them there. Contents never survive from one frame to the next or from one image to another.
+// Before each pass, RecordBarriers() hands the memory of every image that starts in it over from the images it aliases,
+// which also covers their use in the previous frame.
+// Rebuild it from scratch when the set of passes or the swap chain extent changes.
+class TransientImagePool
+{
+public:
+	using ImageId = uint32_t;
+
+	void Create(DeviceAllocator* allocator, HostAllocator* hostAllocator, VkDevice device);
+	// The GPU must be done with every image.
+	void Destroy();
+
+	// Only before Build(). usage should include VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT only if the image is never sampled.
+	ImageId AddImage(const TransientImageDesc& desc);
+	void Build();
+
+	// The handles don't change between frames, so framebuffers and descriptors can be built once. Getting them doesn't
+	// hand the memory over, though: every frame, record RecordBarriers() for each pass before the pass begins. Without
+	// it an image may be written while an alias is still using the same memory, and its layout stays undefined.
+	VkImage GetImage(ImageId id) const { return m_Images[id].image; }
+	VkImageView GetImageView(ImageId id) const { return m_Images[id].view; }
+
+	// Transitions the images first used by pass from VK_IMAGE_LAYOUT_UNDEFINED to their layout, after the images sharing
+	// their memory are done with it. Record it outside of a render pass, right before pass begins. Records nothing if
+	// no image starts in pass.
+	void RecordBarriers(VkCommandBuffer commandBuffer, uint32_t pass) const;
+
+	// Memory taken with aliasing, and what the images would take on their own.
+	VkDeviceSize GetAliasedSize() const { return m_AliasedSize; }
+	VkDeviceSize GetUnaliasedSize() const { return m_UnaliasedSize; }
+private:
+	struct Image
+	{
+		TransientImageDesc desc;
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkMemoryRequirements requirements{};
+		VkDeviceSize offset = 0;
+		// Images placed on overlapping memory, that is every image this one has to wait for.
+		std::vector<ImageId> aliases;
+	};
+private:
+	DeviceAllocator* m_Allocator = nullptr;
+	HostAllocator* m_HostAllocator = nullptr;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	std::vector<Image> m_Images;
+	Allocation* m_Allocation = nullptr;
+	VkDeviceSize m_AliasedSize = 0;
+	VkDeviceSize m_UnaliasedSize = 0;
+};
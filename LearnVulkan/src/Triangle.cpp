@@ -1,5 +1,12 @@
 #include "Triangle.h"
 #include <set>
+#include <map>
+
+HelloTriangleApplication::HelloTriangleApplication(uint32_t maxFramesInFlight)
+	: m_MaxFramesInFlight(std::max(maxFramesInFlight, 1u)),
+	m_WorkerPool(std::max(std::thread::hardware_concurrency(), 2u) - 1)
+{
+}
 
 void HelloTriangleApplication::Run()
 {
@@ -9,11 +16,33 @@ void HelloTriangleApplication::Run()
 	Cleanup();
 }
 
+void HelloTriangleApplication::SetPresentPolicy(const PresentPolicy& policy)
+{
+	if (std::this_thread::get_id() != m_MainThreadId)
+		throw std::runtime_error("SetPresentPolicy must be called from the main thread!");
+
+	// Once rendering has started, the policy belongs to the render thread.
+	if (m_Running)
+		PushEvent(PresentPolicyEvent{ policy });
+	else
+		ApplyPresentPolicy(policy);
+}
+
+void HelloTriangleApplication::ApplyPresentPolicy(const PresentPolicy& policy)
+{
+	// Only the present mode and image count are baked into the swap chain, the rest applies from the next frame.
+	if (m_Device != VK_NULL_HANDLE && (policy.mode != m_PresentPolicy.mode || policy.imageCount != m_PresentPolicy.imageCount))
+		m_PresentPolicyChanged = true;
+
+	m_PresentPolicy = policy;
+	m_FrameLimiter.SetMaxFrameRate(policy.maxFrameRate);
+}
+
 bool HelloTriangleApplication::InitWindow()
 {
 	glfwInit();
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 	m_Window = glfwCreateWindow(m_WIDTH, m_HEIGHT, "LearnVulkan", nullptr, nullptr);
 	if (m_Window == nullptr)
@@ -23,6 +52,13 @@ bool HelloTriangleApplication::InitWindow()
 		return false;
 	}
 
+	glfwGetFramebufferSize(m_Window, &m_FramebufferWidth, &m_FramebufferHeight);
+
+	glfwSetWindowUserPointer(m_Window, this);
+	glfwSetFramebufferSizeCallback(m_Window, FramebufferResizeCallback);
+	glfwSetWindowIconifyCallback(m_Window, WindowIconifyCallback);
+	glfwSetKeyCallback(m_Window, KeyCallback);
+
 	return true;
 }
 
@@ -35,11 +71,14 @@ void HelloTriangleApplication::InitVulkan()
 	CreateLogicalDevice();
 	CreateSwapChain();
 	CreateImageViews();
+	CreateRenderTargets();
 	CreateRenderPass();
+	CreateDescriptorSetLayout();
 	CreateGraphicsPipeline();
 	CreateFramebuffers();
-	CreateCommandPool();
-	CreateCommandBuffer();
+	CreateCommandAllocators();
+	CreateDescriptorSets();
+	CreateIndexBuffer();
 	CreateSyncObjects();
 }
 
@@ -80,7 +119,7 @@ void HelloTriangleApplication::CreateInstance()
 	if (m_EnableValidationLayers && !CheckValidationLayerSupport())
 		throw std::runtime_error("Validation layers requested, but not available!");
 
-	if (vkCreateInstance(&createInfo, nullptr, &m_Instance) != VK_SUCCESS)
+	if (vkCreateInstance(&createInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_INSTANCE), &m_Instance) != VK_SUCCESS)
 		throw std::runtime_error("Failed to Create Vulkan Instance!");
 }
 
@@ -130,13 +169,13 @@ void HelloTriangleApplication::SetupDebugMessenger()
 	VkDebugUtilsMessengerCreateInfoEXT createInfo{};
 	PopulateDebugMessengerCreateInfo(createInfo);
 
-	if (CreateDebugUtilsMessengerEXT(m_Instance, &createInfo, nullptr, &m_DebugMessenger) != VK_SUCCESS)
+	if (CreateDebugUtilsMessengerEXT(m_Instance, &createInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_DEBUG_UTILS_MESSENGER_EXT), &m_DebugMessenger) != VK_SUCCESS)
 		throw std::runtime_error("Failed to set up debug messenger!");
 }
 
 void HelloTriangleApplication::CreateSurface()
 {
-	if (glfwCreateWindowSurface(m_Instance, m_Window, nullptr, &m_Surface) != VK_SUCCESS)
+	if (glfwCreateWindowSurface(m_Instance, m_Window, m_HostAllocator.Get(VK_OBJECT_TYPE_SURFACE_KHR), &m_Surface) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create window surface!");
 }
 
@@ -160,12 +199,16 @@ void HelloTriangleApplication::PickPhysicalDevice()
 
 	if(m_PhysicalDevice == VK_NULL_HANDLE)
 		throw std::runtime_error("Failed to find a suitable GPU");
+
+	m_MsaaSamples = ChooseMsaaSamples();
+	m_DepthFormat = FindDepthFormat();
 }
 
 bool HelloTriangleApplication::IsDeviceSuitable(VkPhysicalDevice device)
 {
 	QueueFamilyIndices indices = FindQueueFamilies(device);
 	bool extensionsSupported = CheckDeviceExtensionSupport(device);
+	bool featuresSupported = CheckDeviceFeatureSupport(device);
 
 	bool swapChainAdequate = false;
 	if (extensionsSupported)
@@ -174,7 +217,7 @@ bool HelloTriangleApplication::IsDeviceSuitable(VkPhysicalDevice device)
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 	}
 
-	return indices.IsComplete() && extensionsSupported && swapChainAdequate;
+	return indices.IsComplete() && extensionsSupported && featuresSupported && swapChainAdequate;
 }
 
 bool HelloTriangleApplication::CheckDeviceExtensionSupport(VkPhysicalDevice device)
@@ -193,6 +236,44 @@ bool HelloTriangleApplication::CheckDeviceExtensionSupport(VkPhysicalDevice devi
 	return requiredExtensions.empty();
 }
 
+bool HelloTriangleApplication::CheckDeviceFeatureSupport(VkPhysicalDevice device)
+{
+	// Timeline semaphores and synchronization2 are core since Vulkan 1.2 and 1.3, but the device still has to report the features.
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device, &properties);
+	if (properties.apiVersion < VK_API_VERSION_1_3)
+		return false;
+
+	VkPhysicalDeviceVulkan13Features features13{};
+	features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	features12.pNext = &features13;
+
+	VkPhysicalDeviceFeatures2 features{};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &features12;
+	vkGetPhysicalDeviceFeatures2(device, &features);
+
+	return features12.timelineSemaphore == VK_TRUE && features13.synchronization2 == VK_TRUE;
+}
+
+bool HelloTriangleApplication::IsDeviceExtensionAvailable(VkPhysicalDevice device, const char* extensionName)
+{
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto& extension : availableExtensions)
+		if (strcmp(extension.extensionName, extensionName) == 0)
+			return true;
+
+	return false;
+}
+
 QueueFamilyIndices HelloTriangleApplication::FindQueueFamilies(VkPhysicalDevice device)
 {
 	QueueFamilyIndices indices;
@@ -205,17 +286,47 @@ QueueFamilyIndices HelloTriangleApplication::FindQueueFamilies(VkPhysicalDevice
 
 	VkBool32 presentSupport = false;
 
-	int i = 0;
-	for (const auto& queueFamily : queueFamilies)
+	// Every family is visited, the compute family can only be chosen once all of them are known.
+	for (uint32_t i = 0; i < queueFamilyCount; i++)
 	{
-		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)	indices.graphicsFamily = i;
+		if (!indices.graphicsFamily.has_value() && (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) indices.graphicsFamily = i;
 		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_Surface, &presentSupport);
-		if (presentSupport) indices.presentFamily = i;
-		if (indices.IsComplete()) break;
-		i++;
+		if (!indices.presentFamily.has_value() && presentSupport) indices.presentFamily = i;
+	}
+
+	if (!indices.graphicsFamily.has_value())
+		return indices;
+
+	// Prefer a compute-only family, which usually maps to dedicated async compute hardware.
+	// Then any other compute capable family, then a second queue of the graphics family.
+	for (uint32_t i = 0; i < queueFamilyCount && !indices.computeFamily.has_value(); i++)
+		if ((queueFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+			indices.computeFamily = i;
+
+	for (uint32_t i = 0; i < queueFamilyCount && !indices.computeFamily.has_value(); i++)
+		if ((queueFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && i != indices.graphicsFamily.value())
+			indices.computeFamily = i;
+
+	if (!indices.computeFamily.has_value())
+	{
+		// Graphics families always support compute. Without a second queue, compute work shares the graphics queue.
+		indices.computeFamily = indices.graphicsFamily;
+		indices.computeQueueIndex = queueFamilies[indices.graphicsFamily.value()].queueCount > 1 ? 1 : 0;
+	}
+
+	// Transfer-only families are backed by the copy engines and run uploads without touching the graphics queue.
+	for (uint32_t i = 0; i < queueFamilyCount && !indices.transferFamily.has_value(); i++)
+		if ((queueFamilies[i].queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamilies[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+			indices.transferFamily = i;
+
+	if (!indices.transferFamily.has_value())
+	{
+		// Otherwise use the next free queue of the graphics family, or share the graphics queue as a last resort.
+		uint32_t usedQueues = indices.computeFamily == indices.graphicsFamily ? indices.computeQueueIndex + 1 : 1;
+		indices.transferFamily = indices.graphicsFamily;
+		indices.transferQueueIndex = queueFamilies[indices.graphicsFamily.value()].queueCount > usedQueues ? usedQueues : 0;
 	}
 
-	// Assign index to queue families that could be found
 	return indices;
 }
 
@@ -255,9 +366,26 @@ VkSurfaceFormatKHR HelloTriangleApplication::ChooseSwapSurfaceFormat(const std::
 
 VkPresentModeKHR HelloTriangleApplication::ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
 {
-	for (const auto& availablePresentMode : availablePresentModes)
-		if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
-			return availablePresentMode;
+	// Preferred modes in order, falling back towards FIFO which every device has to support.
+	std::vector<VkPresentModeKHR> preferredModes;
+	switch (m_PresentPolicy.mode)
+	{
+	case PresentMode::LowLatency:
+		preferredModes = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+		break;
+	case PresentMode::Mailbox:
+		preferredModes = { VK_PRESENT_MODE_MAILBOX_KHR };
+		break;
+	case PresentMode::FifoRelaxed:
+		preferredModes = { VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+		break;
+	case PresentMode::Fifo:
+		break;
+	}
+
+	for (auto preferredMode : preferredModes)
+		if (std::find(availablePresentModes.begin(), availablePresentModes.end(), preferredMode) != availablePresentModes.end())
+			return preferredMode;
 
 	return VK_PRESENT_MODE_FIFO_KHR;
 }
@@ -269,10 +397,7 @@ VkExtent2D HelloTriangleApplication::ChooseSwapExtent(const VkSurfaceCapabilitie
 		return capabilities.currentExtent;
 	}else
 	{
-		int width, height;
-		glfwGetFramebufferSize(m_Window, &width, &height);
-
-		VkExtent2D actualExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+		VkExtent2D actualExtent = { static_cast<uint32_t>(m_FramebufferWidth), static_cast<uint32_t>(m_FramebufferHeight) };
 
 		actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
 		actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
@@ -284,34 +409,128 @@ VkExtent2D HelloTriangleApplication::ChooseSwapExtent(const VkSurfaceCapabilitie
 	}
 }
 
+uint32_t HelloTriangleApplication::ChooseSwapImageCount(const VkSurfaceCapabilitiesKHR& capabilities)
+{
+	uint32_t imageCount = m_PresentPolicy.imageCount > 0 ? m_PresentPolicy.imageCount : capabilities.minImageCount + 1;
+
+	imageCount = std::max(imageCount, capabilities.minImageCount);
+	// A max image count of 0 means there is no limit.
+	if (capabilities.maxImageCount > 0 && imageCount > capabilities.maxImageCount)
+		imageCount = capabilities.maxImageCount;
+
+	return imageCount;
+}
+
 void HelloTriangleApplication::CreateLogicalDevice()
 {
 	QueueFamilyIndices indices = FindQueueFamilies(m_PhysicalDevice);
 
-	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+	// Number of queues to create per family, enough for the highest queue index any role uses.
+	std::map<uint32_t, uint32_t> queueCounts;
+	auto useQueue = [&queueCounts](uint32_t family, uint32_t queueIndex) {
+		queueCounts[family] = std::max(queueCounts[family], queueIndex + 1);
+	};
+	useQueue(indices.graphicsFamily.value(), 0);
+	useQueue(indices.presentFamily.value(), 0);
+	useQueue(indices.computeFamily.value(), indices.computeQueueIndex);
+	useQueue(indices.transferFamily.value(), indices.transferQueueIndex);
 
-	float queuePriority = 1.0f;
-	for (uint32_t queueFamily : uniqueQueueFamilies) 
+	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+	const float queuePriorities[] = { 1.0f, 1.0f, 1.0f };
+	for (const auto& [queueFamily, queueCount] : queueCounts) 
 	{
 		VkDeviceQueueCreateInfo queueCreateInfo{};
 		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 		queueCreateInfo.queueFamilyIndex = queueFamily;
-		queueCreateInfo.queueCount = 1;
-		queueCreateInfo.pQueuePriorities = &queuePriority;
+		queueCreateInfo.queueCount = queueCount;
+		queueCreateInfo.pQueuePriorities = queuePriorities;
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	features12.timelineSemaphore = VK_TRUE;
+
+	VkPhysicalDeviceVulkan13Features features13{};
+	features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	features13.synchronization2 = VK_TRUE;
+	features12.pNext = &features13;
+
+	m_EnabledDeviceExtensions = m_DeviceExtensions;
+
+	VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+	presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+	presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	presentWaitFeatures.pNext = &presentIdFeatures;
+
+	if (IsDeviceExtensionAvailable(m_PhysicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+		IsDeviceExtensionAvailable(m_PhysicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceFeatures2 supportedFeatures{};
+		supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supportedFeatures.pNext = &presentWaitFeatures;
+		vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &supportedFeatures);
+
+		m_PresentWaitSupported = presentIdFeatures.presentId == VK_TRUE && presentWaitFeatures.presentWait == VK_TRUE;
+	}
+
+	if (m_PresentWaitSupported)
+	{
+		m_EnabledDeviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+		m_EnabledDeviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+		features13.pNext = &presentWaitFeatures;
+	}
+
+	// Pipelines built from precompiled libraries link in well under a millisecond, the first draw with a new
+	// permutation doesn't wait for a full compile. Without fast linking a link may cost as much as the compile it replaces.
+	VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibraryFeatures{};
+	pipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+	bool pipelineLibrarySupported = false;
+
+	if (IsDeviceExtensionAvailable(m_PhysicalDevice, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+		IsDeviceExtensionAvailable(m_PhysicalDevice, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceFeatures2 supportedFeatures{};
+		supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supportedFeatures.pNext = &pipelineLibraryFeatures;
+		vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &supportedFeatures);
+
+		VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT pipelineLibraryProperties{};
+		pipelineLibraryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &pipelineLibraryProperties;
+		vkGetPhysicalDeviceProperties2(m_PhysicalDevice, &properties);
+
+		pipelineLibrarySupported = pipelineLibraryFeatures.graphicsPipelineLibrary == VK_TRUE &&
+			pipelineLibraryProperties.graphicsPipelineLibraryFastLinking == VK_TRUE;
+	}
+
+	if (pipelineLibrarySupported)
+	{
+		m_EnabledDeviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+		m_EnabledDeviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+		pipelineLibraryFeatures.pNext = features12.pNext;
+		features12.pNext = &pipelineLibraryFeatures;
+	}
+
+	// Lets the budget tracker see what the driver actually has left for us, including other processes' usage.
+	bool memoryBudgetSupported = IsDeviceExtensionAvailable(m_PhysicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (memoryBudgetSupported)
+		m_EnabledDeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
 	VkDeviceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	createInfo.pNext = &features12;
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
 	VkPhysicalDeviceFeatures deviceFeatures{};
 	createInfo.pEnabledFeatures = &deviceFeatures;
 
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(m_DeviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = m_DeviceExtensions.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(m_EnabledDeviceExtensions.size());
+	createInfo.ppEnabledExtensionNames = m_EnabledDeviceExtensions.data();
 
 	if (m_EnableValidationLayers) 
 	{
@@ -323,14 +542,32 @@ void HelloTriangleApplication::CreateLogicalDevice()
 		createInfo.enabledLayerCount = 0;
 	}
 
-	if (vkCreateDevice(m_PhysicalDevice, &createInfo, nullptr, &m_Device) != VK_SUCCESS)
+	if (vkCreateDevice(m_PhysicalDevice, &createInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_DEVICE), &m_Device) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create logical device!");
 
 	vkGetDeviceQueue(m_Device, indices.graphicsFamily.value(), 0, &m_GraphicsQueue);
 	vkGetDeviceQueue(m_Device, indices.presentFamily.value(), 0, &m_PresentQueue);
+	vkGetDeviceQueue(m_Device, indices.computeFamily.value(), indices.computeQueueIndex, &m_ComputeQueue);
+	vkGetDeviceQueue(m_Device, indices.transferFamily.value(), indices.transferQueueIndex, &m_TransferQueue);
+
+	m_DeviceAllocator.Create(&m_HostAllocator, m_PhysicalDevice, m_Device);
+	m_MemoryBudget.Create(m_PhysicalDevice, &m_DeviceAllocator, &m_DeletionQueue, memoryBudgetSupported);
+	m_PipelineCache.Create(m_PhysicalDevice, m_Device, "pipeline_cache.bin", m_HostAllocator.Get(VK_OBJECT_TYPE_PIPELINE_CACHE));
+	m_PipelineCompiler.Create(m_Device, m_PipelineCache.Get(), m_HostAllocator.Get(VK_OBJECT_TYPE_PIPELINE), s_PipelineCompileThreadCount,
+		pipelineLibrarySupported);
+	m_PipelineStates.Create(&m_PipelineCompiler, m_Device, m_HostAllocator.Get(VK_OBJECT_TYPE_PIPELINE), &m_DeletionQueue);
+	m_LastPipelineCacheSave = std::chrono::steady_clock::now();
+
+	m_QueueFamilies = indices;
+
+	if (m_PresentWaitSupported)
+	{
+		m_vkWaitForPresentKHR = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(m_Device, "vkWaitForPresentKHR");
+		m_PresentWaitSupported = m_vkWaitForPresentKHR != nullptr;
+	}
 }
 
-void HelloTriangleApplication::CreateSwapChain()
+void HelloTriangleApplication::CreateSwapChain(VkSwapchainKHR oldSwapChain)
 {
 	SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(m_PhysicalDevice);
 
@@ -338,9 +575,7 @@ void HelloTriangleApplication::CreateSwapChain()
 	VkPresentModeKHR presentMode = ChooseSwapPresentMode(swapChainSupport.presentModes);
 	VkExtent2D extent = ChooseSwapExtent(swapChainSupport.capabilities);
 
-	uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-	if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
-		imageCount = swapChainSupport.capabilities.maxImageCount;
+	uint32_t imageCount = ChooseSwapImageCount(swapChainSupport.capabilities);
 
 	VkSwapchainCreateInfoKHR createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -370,8 +605,9 @@ void HelloTriangleApplication::CreateSwapChain()
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE;
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
-	if (vkCreateSwapchainKHR(m_Device, &createInfo, nullptr, &m_SwapChain) != VK_SUCCESS)
+	// Handing over the old swap chain lets the driver reuse its resources and keep presenting while we switch.
+	createInfo.oldSwapchain = oldSwapChain;
+	if (vkCreateSwapchainKHR(m_Device, &createInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_SWAPCHAIN_KHR), &m_SwapChain) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create swap chain!");
 
 	vkGetSwapchainImagesKHR(m_Device, m_SwapChain, &imageCount, nullptr);
@@ -379,6 +615,44 @@ void HelloTriangleApplication::CreateSwapChain()
 	vkGetSwapchainImagesKHR(m_Device, m_SwapChain, &imageCount, m_SwapChainImages.data());
 	m_SwapChainImageFormat = surfaceFormat.format;
 	m_SwapChainExtent = extent;
+	m_FirstPresentId = m_LastPresentId + 1;
+}
+
+bool HelloTriangleApplication::RecreateSwapChain()
+{
+	// A minimized window has no surface area to render to, try again once it is restored.
+	if (m_FramebufferWidth == 0 || m_FramebufferHeight == 0)
+		return false;
+
+	RetiredSwapChain retired{};
+	retired.swapChain = m_SwapChain;
+	retired.imageViews = std::move(m_SwapChainImageViews);
+	retired.framebuffers = std::move(m_SwapChainFramebuffers);
+	retired.renderTargets = { m_ColorTarget, m_DepthTarget };
+
+	CreateSwapChain(retired.swapChain);
+	CreateImageViews();
+	CreateRenderTargets();
+	CreateFramebuffers();
+
+	// Presents are processed in queue order, so the old images are off screen once one on the new swap chain went out.
+	m_RetiredSwapChains.push_back(std::move(retired));
+	m_ImagesInFlight.assign(m_SwapChainImages.size(), 0);
+	m_FramebufferResized = false;
+	m_PresentPolicyChanged = false;
+	return true;
+}
+
+void HelloTriangleApplication::DestroySwapChainResources(VkSwapchainKHR swapChain, const std::vector<VkImageView>& imageViews, const std::vector<VkFramebuffer>& framebuffers,
+	const std::vector<RenderTarget>& renderTargets)
+{
+	for (auto framebuffer : framebuffers)
+		vkDestroyFramebuffer(m_Device, framebuffer, m_HostAllocator.Get(VK_OBJECT_TYPE_FRAMEBUFFER));
+	for (const auto& target : renderTargets)
+		DestroyRenderTarget(target);
+	for (auto imageView : imageViews)
+		vkDestroyImageView(m_Device, imageView, m_HostAllocator.Get(VK_OBJECT_TYPE_IMAGE_VIEW));
+	vkDestroySwapchainKHR(m_Device, swapChain, m_HostAllocator.Get(VK_OBJECT_TYPE_SWAPCHAIN_KHR));
 }
 
 void HelloTriangleApplication::CreateImageViews()
@@ -402,192 +676,226 @@ void HelloTriangleApplication::CreateImageViews()
 		createInfo.subresourceRange.baseArrayLayer = 0;
 		createInfo.subresourceRange.layerCount = 1;
 
-		if (vkCreateImageView(m_Device, &createInfo, nullptr, &m_SwapChainImageViews[i]) != VK_SUCCESS)
+		if (vkCreateImageView(m_Device, &createInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_IMAGE_VIEW), &m_SwapChainImageViews[i]) != VK_SUCCESS)
 			throw std::runtime_error("Failed to create image views!");
 	}
 }
 
+VkSampleCountFlagBits HelloTriangleApplication::ChooseMsaaSamples()
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+
+	VkSampleCountFlags counts = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+	for (uint32_t samples = s_MaxMsaaSamples; samples > VK_SAMPLE_COUNT_1_BIT; samples >>= 1)
+		if (counts & samples)
+			return static_cast<VkSampleCountFlagBits>(samples);
+
+	return VK_SAMPLE_COUNT_1_BIT;
+}
+
+VkFormat HelloTriangleApplication::FindDepthFormat()
+{
+	// Stencil isn't used, formats without it come first.
+	VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D16_UNORM };
+	for (VkFormat format : candidates)
+	{
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(m_PhysicalDevice, format, &properties);
+		if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+			return format;
+	}
+
+	throw std::runtime_error("Failed to find a supported depth format!");
+}
+
+void HelloTriangleApplication::CreateRenderTargets()
+{
+	VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (m_DepthFormat == VK_FORMAT_D24_UNORM_S8_UINT || m_DepthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT)
+		depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+	m_DepthTarget = CreateRenderTarget(m_DepthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, depthAspect);
+	m_ColorTarget = m_MsaaSamples != VK_SAMPLE_COUNT_1_BIT
+		? CreateRenderTarget(m_SwapChainImageFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT)
+		: RenderTarget{};
+}
+
+RenderTarget HelloTriangleApplication::CreateRenderTarget(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspectMask)
+{
+	RenderTarget target{};
+
+	// Transient, the render pass neither loads nor stores it, so tile-based GPUs never have to back it with memory.
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = format;
+	imageInfo.extent = { m_SwapChainExtent.width, m_SwapChainExtent.height, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = m_MsaaSamples;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	if (vkCreateImage(m_Device, &imageInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_IMAGE), &target.image) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create render target!");
+
+	target.allocation = m_DeviceAllocator.AllocateImage(target.image, VK_IMAGE_TILING_OPTIMAL, MemoryUsage::GpuLazy);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = target.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = format;
+	viewInfo.subresourceRange.aspectMask = aspectMask;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	if (vkCreateImageView(m_Device, &viewInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_IMAGE_VIEW), &target.view) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create render target view!");
+
+	return target;
+}
+
+void HelloTriangleApplication::DestroyRenderTarget(const RenderTarget& target)
+{
+	if (target.image == VK_NULL_HANDLE)
+		return;
+
+	vkDestroyImageView(m_Device, target.view, m_HostAllocator.Get(VK_OBJECT_TYPE_IMAGE_VIEW));
+	vkDestroyImage(m_Device, target.image, m_HostAllocator.Get(VK_OBJECT_TYPE_IMAGE));
+	m_DeviceAllocator.Free(target.allocation);
+}
+
 void HelloTriangleApplication::CreateRenderPass()
 {
+	bool resolve = m_MsaaSamples != VK_SAMPLE_COUNT_1_BIT;
+
+	// Multisampled color and depth only live within the pass: cleared on load, never stored.
 	VkAttachmentDescription colorAttachment{};
 	colorAttachment.format = m_SwapChainImageFormat;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachment.samples = m_MsaaSamples;
 	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.storeOp = resolve ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	colorAttachment.finalLayout = resolve ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkAttachmentDescription depthAttachment{};
+	depthAttachment.format = m_DepthFormat;
+	depthAttachment.samples = m_MsaaSamples;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	// The swap chain image is only written by the resolve, so there is nothing to load.
+	VkAttachmentDescription resolveAttachment{};
+	resolveAttachment.format = m_SwapChainImageFormat;
+	resolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	resolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	resolveAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	resolveAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	resolveAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	resolveAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	resolveAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	VkAttachmentReference colorAttachmentRef{};
 	colorAttachmentRef.attachment = 0;
 	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+	VkAttachmentReference depthAttachmentRef{};
+	depthAttachmentRef.attachment = 1;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference resolveAttachmentRef{};
+	resolveAttachmentRef.attachment = 2;
+	resolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
 	VkSubpassDescription subpass{};
 	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 	subpass.colorAttachmentCount = 1;
 	subpass.pColorAttachments = &colorAttachmentRef;
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorAttachmentRef;
+	subpass.pResolveAttachments = resolve ? &resolveAttachmentRef : nullptr;
+	subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+	VkAttachmentDescription attachments[] = { colorAttachment, depthAttachment, resolveAttachment };
 
 	VkRenderPassCreateInfo renderPassInfo{};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassInfo.attachmentCount = 1;
-	renderPassInfo.pAttachments = &colorAttachment;
+	renderPassInfo.attachmentCount = resolve ? 3 : 2;
+	renderPassInfo.pAttachments = attachments;
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
 
+	// The depth and MSAA color targets are shared by all frames in flight, so the previous frame's writes to them have to
+	// finish as well.
 	VkSubpassDependency dependency{};
 	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
 	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 	renderPassInfo.dependencyCount = 1;
 	renderPassInfo.pDependencies = &dependency;
 
-	if (vkCreateRenderPass(m_Device, &renderPassInfo, nullptr, &m_RenderPass) != VK_SUCCESS)
+	if (vkCreateRenderPass(m_Device, &renderPassInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_RENDER_PASS), &m_RenderPass) != VK_SUCCESS)
 		throw std::runtime_error("failed to create render pass!");
 
 }
 
 void HelloTriangleApplication::CreateGraphicsPipeline()
 {
+	// The modules stay alive with the app, the compile runs on another thread and later requests may reuse them.
 	auto vertShaderCode = ReadFile("src/Shaders/TriangleVert.spv");
 	auto fragShaderCode = ReadFile("src/Shaders/TriangleFrag.spv");
 
-	VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
-	VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
-
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.module = vertShaderModule;
-	vertShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.module = fragShaderModule;
-	fragShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 0;
-	vertexInputInfo.pVertexBindingDescriptions = nullptr; // Optional
-	vertexInputInfo.vertexAttributeDescriptionCount = 0;
-	vertexInputInfo.pVertexAttributeDescriptions = nullptr; // Optional
-
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)m_SwapChainExtent.width;
-	viewport.height = (float)m_SwapChainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor{};
-	scissor.offset = { 0, 0 };
-	scissor.extent = m_SwapChainExtent;
-
-	std::vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-	dynamicState.pDynamicStates = dynamicStates.data();
-
-	VkPipelineViewportStateCreateInfo viewportState{};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
-	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
-
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;	
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-	rasterizer.depthBiasEnable = VK_FALSE;
-	rasterizer.depthBiasConstantFactor = 0.0f; // Optional
-	rasterizer.depthBiasClamp = 0.0f; // Optional
-	rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
-
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-	multisampling.minSampleShading = 1.0f; // Optional
-	multisampling.pSampleMask = nullptr; // Optional
-	multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-	multisampling.alphaToOneEnable = VK_FALSE; // Optional
-
-	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_FALSE;
-	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
-
-	VkPipelineColorBlendStateCreateInfo colorBlending{};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable = VK_FALSE;
-	colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-	colorBlending.blendConstants[0] = 0.0f; // Optional
-	colorBlending.blendConstants[1] = 0.0f; // Optional
-	colorBlending.blendConstants[2] = 0.0f; // Optional
-	colorBlending.blendConstants[3] = 0.0f; // Optional
+	m_VertShaderModule = CreateShaderModule(vertShaderCode);
+	m_FragShaderModule = CreateShaderModule(fragShaderCode);
 
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 0; // Optional
-	pipelineLayoutInfo.pSetLayouts = nullptr; // Optional
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_DescriptorSetLayout;
 	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
 	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
 
-	if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS)
+	if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_PIPELINE_LAYOUT), &m_PipelineLayout) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create pipeline layout!");
 
-	VkGraphicsPipelineCreateInfo pipelineInfo{};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount = 2;
-	pipelineInfo.pStages = shaderStages;
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pRasterizationState = &rasterizer;
-	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pDepthStencilState = nullptr; // Optional
-	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = &dynamicState;
-	pipelineInfo.layout = m_PipelineLayout;
-	pipelineInfo.renderPass = m_RenderPass;
-	pipelineInfo.subpass = 0;
-	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-	pipelineInfo.basePipelineIndex = -1; // Optional
-
-	if (vkCreateGraphicsPipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_GraphicsPipeline) != VK_SUCCESS)
-		throw std::runtime_error("Failed to create graphics pipeline!");
-
-	vkDestroyShaderModule(m_Device, fragShaderModule, nullptr);
-	vkDestroyShaderModule(m_Device, vertShaderModule, nullptr);
+	// Draws all share one depth, LESS_OR_EQUAL keeps later draws on top like without a depth buffer.
+	PipelineDesc baseDesc{};
+	baseDesc.vertexShader = m_VertShaderModule;
+	baseDesc.fragmentShader = m_FragShaderModule;
+	baseDesc.layout = m_PipelineLayout;
+	baseDesc.vertexSpecializationIds = 1u << VertexColors;
+	baseDesc.fragmentSpecializationIds = (1u << Monochrome) | (1u << ColorLevels);
+	baseDesc.samples = m_MsaaSamples;
+	baseDesc.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	baseDesc.renderPass = m_RenderPass;
+	baseDesc.subpass = 0;
+	baseDesc.colorFormat = m_SwapChainImageFormat;
+	baseDesc.depthFormat = m_DepthFormat;
+
+	// Picked up by DrawFrame once they are done, draws using a variant before that are skipped.
+	m_VariantPipelineIds.clear();
+	for (const auto& variant : m_Variants)
+	{
+		PipelineDesc desc = baseDesc;
+		desc.SetSpecializationConstant(VertexColors, variant.vertexColors ? VK_TRUE : VK_FALSE);
+		desc.SetSpecializationConstant(Monochrome, variant.monochrome ? VK_TRUE : VK_FALSE);
+		desc.SetSpecializationConstant(ColorLevels, variant.colorLevels);
+		m_VariantPipelineIds.push_back(m_PipelineStates.GetOrCreate(desc));
+	}
+	m_VariantPipelines.assign(m_Variants.size(), VK_NULL_HANDLE);
 }
 
 void HelloTriangleApplication::CreateFramebuffers()
@@ -595,47 +903,155 @@ void HelloTriangleApplication::CreateFramebuffers()
 	m_SwapChainFramebuffers.resize(m_SwapChainImageViews.size());
 	for (size_t i = 0; i < m_SwapChainImageViews.size(); i++)
 	{
-		VkImageView attachments[] = { m_SwapChainImageViews[i] };
+		// In render pass attachment order, the swap chain image is the resolve target with multisampling.
+		std::vector<VkImageView> attachments;
+		if (m_ColorTarget.view != VK_NULL_HANDLE)
+			attachments = { m_ColorTarget.view, m_DepthTarget.view, m_SwapChainImageViews[i] };
+		else
+			attachments = { m_SwapChainImageViews[i], m_DepthTarget.view };
 
 		VkFramebufferCreateInfo framebufferInfo{};
 		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 		framebufferInfo.renderPass = m_RenderPass;
-		framebufferInfo.attachmentCount = 1;
-		framebufferInfo.pAttachments = attachments;
+		framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		framebufferInfo.pAttachments = attachments.data();
 		framebufferInfo.width = m_SwapChainExtent.width;
 		framebufferInfo.height = m_SwapChainExtent.height;
 		framebufferInfo.layers = 1;
 
-		if (vkCreateFramebuffer(m_Device, &framebufferInfo, nullptr, &m_SwapChainFramebuffers[i]) != VK_SUCCESS)
+		if (vkCreateFramebuffer(m_Device, &framebufferInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_FRAMEBUFFER), &m_SwapChainFramebuffers[i]) != VK_SUCCESS)
 			throw std::runtime_error("Failed to create framebuffer!");
 	}
 }
 
-void HelloTriangleApplication::CreateCommandPool()
+void HelloTriangleApplication::CreateDescriptorSetLayout()
+{
+	// Both bindings point into the frame ring buffer, draws only change the dynamic offsets.
+	VkDescriptorSetLayoutBinding bindings[2]{};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT), &m_DescriptorSetLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create descriptor set layout!");
+}
+
+void HelloTriangleApplication::CreateDescriptorSets()
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+	VkDeviceSize alignment = std::max(properties.limits.minUniformBufferOffsetAlignment, properties.limits.minStorageBufferOffsetAlignment);
+	// Only the uniform binding moves to arbitrary offsets, the storage binding never reaches past the last region.
+	m_FrameRing.Create(&m_DeviceAllocator, &m_HostAllocator, m_Device, s_FrameRingBytesPerFrame, m_MaxFramesInFlight, alignment, s_DynamicUniformRange);
+
+	VkDescriptorPoolSize poolSizes[2]{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = 1;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	poolSizes[1].descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 2;
+	poolInfo.pPoolSizes = poolSizes;
+
+	if (vkCreateDescriptorPool(m_Device, &poolInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_DESCRIPTOR_POOL), &m_DescriptorPool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create descriptor pool!");
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_DescriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &m_DescriptorSetLayout;
+
+	if (vkAllocateDescriptorSets(m_Device, &allocInfo, &m_DescriptorSet) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate descriptor set!");
+
+	// One set for every frame and draw, the ring buffer never moves.
+	VkDescriptorBufferInfo bufferInfos[2]{};
+	bufferInfos[0].buffer = m_FrameRing.GetBuffer();
+	bufferInfos[0].offset = 0;
+	bufferInfos[0].range = s_DynamicUniformRange;
+	bufferInfos[1].buffer = m_FrameRing.GetBuffer();
+	bufferInfos[1].offset = 0;
+	bufferInfos[1].range = s_DynamicStorageRange;
+
+	VkWriteDescriptorSet descriptorWrites[2]{};
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = m_DescriptorSet;
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+	vkUpdateDescriptorSets(m_Device, 2, descriptorWrites, 0, nullptr);
+}
+
+void HelloTriangleApplication::CreateCommandAllocators()
 {
 	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice);
 
-	VkCommandPoolCreateInfo poolInfo{};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-	
-	if (vkCreateCommandPool(m_Device, &poolInfo, nullptr, &m_CommandPool) != VK_SUCCESS)
-		throw std::runtime_error("Failed to create command pool!");
+	// Every recording job of every frame in flight gets its own pool, so threads never share one.
+	m_Frames.resize(m_MaxFramesInFlight);
+	uint32_t recordingJobCount = m_WorkerPool.GetThreadCount() + 1;
 
+	for (auto& frame : m_Frames)
+	{
+		frame.commandAllocators.resize(recordingJobCount);
+		for (auto& allocator : frame.commandAllocators)
+			allocator.Create(&m_HostAllocator, m_Device, queueFamilyIndices.graphicsFamily.value());
+		frame.arena.Create(s_FrameArenaSize);
+	}
+
+	m_AsyncCompute.Create(&m_HostAllocator, m_Device, m_ComputeQueue, m_QueueFamilies.computeFamily.value(), m_ComputeQueue != m_GraphicsQueue, m_MaxFramesInFlight, &m_SubmitBatcher);
+	m_UploadEngine.Create(&m_DeviceAllocator, &m_HostAllocator, m_Device, m_TransferQueue, m_QueueFamilies.transferFamily.value(), m_QueueFamilies.graphicsFamily.value(), &m_SubmitBatcher);
+	m_Defragmenter.Create(&m_DeviceAllocator, &m_HostAllocator, m_Device, m_TransferQueue, m_QueueFamilies.transferFamily.value(),
+		m_QueueFamilies.graphicsFamily.value(), &m_SubmitBatcher, &m_GraphicsTimeline, &m_DeletionQueue);
 }
 
-void HelloTriangleApplication::CreateCommandBuffer()
+void HelloTriangleApplication::CreateIndexBuffer()
 {
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = m_CommandPool;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = 1;
+	static constexpr uint16_t indices[] = { 0, 1, 2 };
+
+	// Written by the transfer queue and moved with copies on it, so with a separate transfer family both need access.
+	m_IndexBufferFamilies[0] = m_QueueFamilies.transferFamily.value();
+	m_IndexBufferFamilies[1] = m_QueueFamilies.graphicsFamily.value();
 
-	if (vkAllocateCommandBuffers(m_Device, &allocInfo, &m_CommandBuffer) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to allocate command buffers!");
+	m_IndexBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	m_IndexBufferInfo.size = sizeof(indices);
+	m_IndexBufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	if (m_IndexBufferFamilies[0] != m_IndexBufferFamilies[1])
+	{
+		m_IndexBufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		m_IndexBufferInfo.queueFamilyIndexCount = 2;
+		m_IndexBufferInfo.pQueueFamilyIndices = m_IndexBufferFamilies;
 	}
+	else
+		m_IndexBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(m_Device, &m_IndexBufferInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_BUFFER), &m_IndexBuffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create index buffer!");
+	m_IndexAllocation = m_DeviceAllocator.AllocateBuffer(m_IndexBuffer, MemoryUsage::GpuOnly);
+
+	m_UploadEngine.UploadBuffer(m_IndexBuffer, 0, indices, sizeof(indices), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT,
+		m_IndexBufferInfo.sharingMode);
+	m_IndexUploadValue = m_UploadEngine.Flush();
 }
 
 void HelloTriangleApplication::CreateSyncObjects()
@@ -645,49 +1061,158 @@ void HelloTriangleApplication::CreateSyncObjects()
 	semaphoreInfo.flags = 0;
 	semaphoreInfo.pNext = nullptr;
 
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-	fenceInfo.pNext = nullptr;
+	// The swap chain only works with binary semaphores, everything else waits on the graphics timeline.
+	for (auto& frame : m_Frames)
+	{
+		if (vkCreateSemaphore(m_Device, &semaphoreInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_SEMAPHORE), &frame.imageAvailableSemaphore) != VK_SUCCESS ||
+			vkCreateSemaphore(m_Device, &semaphoreInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_SEMAPHORE), &frame.renderFinishedSemaphore) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create semaphores!");
+	}
 
-	if (vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_ImageAvailableSemaphore) != VK_SUCCESS ||
-		vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_RenderFinishedSemaphore) != VK_SUCCESS ||
-		vkCreateFence(m_Device, &fenceInfo, nullptr, &m_InFlightFence) != VK_SUCCESS)
-		throw std::runtime_error("Failed to create semaphores!");
+	m_GraphicsTimeline.Create(&m_HostAllocator, m_Device);
+	m_DeletionQueue.Create(&m_GraphicsTimeline);
+
+	// Value 0 has always passed, so no swap chain image is waiting on a frame yet.
+	m_ImagesInFlight.assign(m_SwapChainImages.size(), 0);
+}
 
+void HelloTriangleApplication::PaceFrame()
+{
+	uint32_t maxQueuedFrames = m_PresentPolicy.maxQueuedFrames > 0 ? m_PresentPolicy.maxQueuedFrames : m_MaxFramesInFlight;
 
+	if (m_PresentWaitSupported)
+	{
+		// Wait until the display has taken all but maxQueuedFrames of our presents. The timeout keeps an occluded
+		// window, which may never present, from hanging the loop.
+		const uint64_t presentWaitTimeout = 100'000'000; // 100ms
+		uint64_t nextPresentId = m_LastPresentId + 1;
+		if (nextPresentId > maxQueuedFrames && nextPresentId - maxQueuedFrames >= m_FirstPresentId)
+			m_vkWaitForPresentKHR(m_Device, m_SwapChain, nextPresentId - maxQueuedFrames, presentWaitTimeout);
+	}
+	else
+	{
+		// Without present wait, GPU completion is the closest we can get to display progress.
+		uint64_t nextValue = m_GraphicsTimeline.GetLastReserved() + 1;
+		if (nextValue > maxQueuedFrames)
+			m_GraphicsTimeline.Wait(nextValue - maxQueuedFrames);
+	}
+
+	m_FrameLimiter.Wait();
 }
 
 void HelloTriangleApplication::DrawFrame()
 {
-	vkWaitForFences(m_Device, 1, &m_InFlightFence, VK_TRUE, UINT64_MAX);
-	vkResetFences(m_Device, 1, &m_InFlightFence);
+	m_DeletionQueue.Collect();
+
+	if ((m_FramebufferResized || m_PresentPolicyChanged) && !RecreateSwapChain())
+	{
+		m_SubmitBatcher.Flush();
+		return;
+	}
+
+	PaceFrame();
+
+	FrameData& frame = m_Frames[m_CurrentFrame];
+
+	// Only wait for the GPU to finish with this slot, not with every frame that is still in flight.
+	m_GraphicsTimeline.Wait(frame.submittedValue);
+	m_AsyncCompute.BeginFrame(m_CurrentFrame);
+	m_FrameRing.BeginFrame(m_CurrentFrame);
+
+	// Make room before this frame allocates or streams anything in.
+	m_MemoryBudget.Update(m_GraphicsTimeline.GetLastReserved() + 1);
+	m_FrameStats.evictions = m_MemoryBudget.GetEvictions();
 	uint32_t imageIndex;
-	vkAcquireNextImageKHR(m_Device, m_SwapChain, UINT64_MAX, m_ImageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
-	vkResetCommandBuffer(m_CommandBuffer, 0);
-	RecordCommandBuffer(m_CommandBuffer, imageIndex);
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-	VkSemaphore waitSemaphores[] = { m_ImageAvailableSemaphore };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &m_CommandBuffer;
-
-	VkSemaphore signalSemaphores[] = { m_RenderFinishedSemaphore };
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
-	if (vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, m_InFlightFence) != VK_SUCCESS)
-		throw std::runtime_error("Failed to submit draw command buffer!");
+	VkResult result = vkAcquireNextImageKHR(m_Device, m_SwapChain, UINT64_MAX, frame.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		// Nothing was acquired and the semaphore stays unsignaled, so the frame can simply be skipped. Work queued
+		// outside of the frame, e.g. uploads, still goes out, or timeline waits on it would never finish.
+		m_FramebufferResized = true;
+		RecreateSwapChain();
+		m_SubmitBatcher.Flush();
+		return;
+	}
+	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+		throw std::runtime_error("Failed to acquire swap chain image!");
+
+	// The index buffer can move once its upload has been acquired by an earlier frame.
+	if (!m_IndexBufferReady && m_UploadEngine.IsAcquired(m_IndexUploadValue))
+	{
+		m_IndexBufferId = m_Defragmenter.RegisterBuffer(m_IndexBuffer, m_IndexAllocation, m_IndexBufferInfo,
+			[this](VkBuffer buffer, Allocation* allocation) {
+				m_IndexBuffer = buffer;
+				m_IndexAllocation = allocation;
+			});
+		m_IndexBufferReady = true;
+	}
+
+	// Only a frame that is going to be submitted may start moves or rebind buffers, the copies and the wait for finished
+	// ones go out with its submissions.
+	if (std::optional<TimelineWait> defragWait = m_Defragmenter.Step(s_DefragTimeBudget))
+		WaitOnGraphics(*defragWait);
+	m_FrameStats.totalDefragBytesMoved = m_Defragmenter.GetStats().totalBytesMoved;
+	m_FrameStats.totalDefragBlocksReleased = m_Defragmenter.GetStats().totalBlocksReleased;
+
+	// The swap chain may hand out images out of order, so an older frame could still be rendering to this one.
+	m_GraphicsTimeline.Wait(m_ImagesInFlight[imageIndex]);
+
+	// The GPU is done with this slot, so all of its command buffers and CPU data can be recycled at once.
+	for (auto& allocator : frame.commandAllocators)
+		allocator.Reset();
+	frame.arena.Reset();
+
+	// Kick off this frame's uploads, the graphics queue picks them up once the transfer queue is done.
+	m_UploadEngine.Flush();
+
+	auto frameTime = std::chrono::steady_clock::now();
+	double frameSeconds = m_LastFrameTime ? std::chrono::duration<double>(frameTime - *m_LastFrameTime).count() : 0.0;
+	m_LastFrameTime = frameTime;
+	m_FrameStats.uploadBytes = m_UploadEngine.GetFlushedBytes();
+	m_FrameStats.uploadCopyCommands = m_UploadEngine.GetFlushedCopyCommands();
+	m_FrameStats.uploadBandwidth = frameSeconds > 0.0 ? m_FrameStats.uploadBytes / frameSeconds : 0.0;
+
+	m_PipelineStates.Update();
+	for (size_t i = 0; i < m_VariantPipelineIds.size(); i++)
+		m_VariantPipelines[i] = m_PipelineStates.Get(m_VariantPipelineIds[i]);
+	m_FrameStats.pendingPipelines = m_PipelineCompiler.GetPendingCount();
+	RecordCommandBuffer(frame, imageIndex);
+
+	m_FrameStats.commandBufferAllocations = 0;
+	for (const auto& allocator : frame.commandAllocators)
+		m_FrameStats.commandBufferAllocations += allocator.GetAllocationsSinceReset();
+	m_FrameStats.totalCommandBufferAllocations += m_FrameStats.commandBufferAllocations;
+	m_FrameStats.frameArenaBytes = frame.arena.GetUsedBytes();
+	m_FrameStats.frameArenaOverflows = frame.arena.GetOverflowCount();
+
+	// Values for the binary semaphores are ignored.
+	m_GraphicsWaitInfos.clear();
+	m_GraphicsWaitInfos.push_back(SubmitBatcher::SemaphoreInfo(frame.imageAvailableSemaphore, 0, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT));
+	for (const auto& wait : m_GraphicsWaits)
+		m_GraphicsWaitInfos.push_back(SubmitBatcher::SemaphoreInfo(wait));
+	m_GraphicsWaits.clear();
+
+	uint64_t frameValue = m_GraphicsTimeline.Next();
+	VkSemaphoreSubmitInfo signalInfos[] = {
+		SubmitBatcher::SemaphoreInfo(frame.renderFinishedSemaphore, 0, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT),
+		SubmitBatcher::SemaphoreInfo(m_GraphicsTimeline.GetSemaphore(), frameValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT) };
+	m_SubmitBatcher.Add(m_GraphicsQueue, { &frame.commandBuffer, 1 }, m_GraphicsWaitInfos, signalInfos, &m_GraphicsTimeline);
+
+	// Uploads, compute and graphics work of the whole frame go out together, with one submit per queue.
+	m_SubmitBatcher.Flush();
+	m_FrameStats.queueSubmits = m_SubmitBatcher.GetSubmitCalls();
+	m_FrameStats.submissions = m_SubmitBatcher.GetSubmissions();
+	m_FrameStats.totalQueueSubmits += m_FrameStats.queueSubmits;
+	m_SubmitBatcher.ResetStats();
+
+	frame.submittedValue = frameValue;
+	m_ImagesInFlight[imageIndex] = frameValue;
 
 	VkPresentInfoKHR presentInfo{};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
 	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
+	presentInfo.pWaitSemaphores = &frame.renderFinishedSemaphore;
 
 	VkSwapchainKHR swapChains[] = { m_SwapChain };
 	presentInfo.swapchainCount = 1;
@@ -695,31 +1220,150 @@ void HelloTriangleApplication::DrawFrame()
 	presentInfo.pImageIndices = &imageIndex;
 	presentInfo.pResults = nullptr; // Optional
 
-	vkQueuePresentKHR(m_PresentQueue, &presentInfo);	
+	uint64_t presentId = 0;
+	VkPresentIdKHR presentIdInfo{};
+	if (m_PresentWaitSupported)
+	{
+		presentId = ++m_LastPresentId;
+		presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+		presentIdInfo.swapchainCount = 1;
+		presentIdInfo.pPresentIds = &presentId;
+		presentInfo.pNext = &presentIdInfo;
+	}
+
+	result = vkQueuePresentKHR(m_PresentQueue, &presentInfo);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+		m_FramebufferResized = true;
+	else if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to present swap chain image!");
+
+	// The new swap chain has presented, retired ones can go once this frame has passed.
+	if (result != VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		for (auto& retired : m_RetiredSwapChains)
+		{
+			m_DeletionQueue.Push(frameValue, [this, retired = std::move(retired)]() {
+				DestroySwapChainResources(retired.swapChain, retired.imageViews, retired.framebuffers, retired.renderTargets);
+			});
+		}
+		m_RetiredSwapChains.clear();
+	}
+
+	m_CurrentFrame = (m_CurrentFrame + 1) % m_MaxFramesInFlight;
+}
+
+uint64_t HelloTriangleApplication::SubmitCompute(const std::function<void(VkCommandBuffer)>& record, const std::vector<TimelineWait>& waits)
+{
+	return m_AsyncCompute.Submit(record, waits);
+}
+
+void HelloTriangleApplication::WaitOnGraphics(const TimelineWait& wait)
+{
+	m_GraphicsWaits.push_back(wait);
 }
 
-void HelloTriangleApplication::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+void HelloTriangleApplication::RecordCommandBuffer(FrameData& frame, uint32_t imageIndex)
 {
+	// Split the draw list into one contiguous range per job, small lists are not worth handing to another thread.
+	uint32_t drawCount = static_cast<uint32_t>(m_DrawList.size());
+	uint32_t maxJobCount = static_cast<uint32_t>(frame.commandAllocators.size());
+	uint32_t jobCount = std::min((drawCount + s_MinDrawsPerRecordingJob - 1) / s_MinDrawsPerRecordingJob, maxJobCount);
+	uint32_t drawsPerJob = jobCount > 0 ? (drawCount + jobCount - 1) / jobCount : 0;
+
+	// Workers record into this frame's allocators and may still be running when something fails, so every job has to
+	// finish before the first error is passed on.
+	std::exception_ptr error;
+	FrameVector<std::future<VkCommandBuffer>> jobs = frame.arena.MakeVector<std::future<VkCommandBuffer>>(jobCount);
+	FrameVector<VkCommandBuffer> secondaryCommandBuffers = frame.arena.MakeVector<VkCommandBuffer>(jobCount);
+	try
+	{
+		for (uint32_t job = 1; job < jobCount; job++)
+		{
+			uint32_t firstDraw = std::min(job * drawsPerJob, drawCount);
+			uint32_t lastDraw = std::min(firstDraw + drawsPerJob, drawCount);
+			CommandAllocator* allocator = &frame.commandAllocators[job];
+			jobs.push_back(m_WorkerPool.Submit([this, allocator, imageIndex, firstDraw, lastDraw]() {
+				return RecordDraws(*allocator, imageIndex, firstDraw, lastDraw);
+			}));
+		}
+
+		// Record the first range here instead of waiting idle for the workers.
+		if (jobCount > 0)
+			secondaryCommandBuffers.push_back(RecordDraws(frame.commandAllocators[0], imageIndex, 0, std::min(drawsPerJob, drawCount)));
+	}
+	catch (...)
+	{
+		error = std::current_exception();
+	}
+	for (auto& job : jobs)
+	{
+		try
+		{
+			secondaryCommandBuffers.push_back(job.get());
+		}
+		catch (...)
+		{
+			if (!error)
+				error = std::current_exception();
+		}
+	}
+	m_FrameStats.skippedDraws = m_SkippedDraws.exchange(0);
+	if (error)
+		std::rethrow_exception(error);
+
+	frame.commandBuffer = frame.commandAllocators[0].Allocate(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	VkCommandBuffer commandBuffer = frame.commandBuffer;
+
 	VkCommandBufferBeginInfo beginInfo{};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = 0; // Optional
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 	beginInfo.pInheritanceInfo = nullptr; // Optional
 
 	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
 		throw std::runtime_error("Failed to begin recording command buffer!");
 
+	// Uploads the transfer queue has finished become usable from this frame on.
+	if (std::optional<TimelineWait> uploadWait = m_UploadEngine.RecordAcquires(commandBuffer))
+		WaitOnGraphics(*uploadWait);
+
 	VkRenderPassBeginInfo renderPassInfo{};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	renderPassInfo.renderPass = m_RenderPass;
 	renderPassInfo.framebuffer = m_SwapChainFramebuffers[imageIndex];
 	renderPassInfo.renderArea.offset = { 0, 0 };
 	renderPassInfo.renderArea.extent = m_SwapChainExtent;
-	VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
-	renderPassInfo.clearValueCount = 1;
-	renderPassInfo.pClearValues = &clearColor;
-	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	VkClearValue clearValues[2]{};
+	clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+	renderPassInfo.clearValueCount = 2;
+	renderPassInfo.pClearValues = clearValues;
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+	if (!secondaryCommandBuffers.empty())
+		vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaryCommandBuffers.size()), secondaryCommandBuffers.data());
 
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipeline);
+	vkCmdEndRenderPass(commandBuffer);
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		throw std::runtime_error("failed to record command buffer!");
+}
+
+VkCommandBuffer HelloTriangleApplication::RecordDraws(CommandAllocator& allocator, uint32_t imageIndex, uint32_t firstDraw, uint32_t lastDraw)
+{
+	VkCommandBuffer commandBuffer = allocator.Allocate(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+	VkCommandBufferInheritanceInfo inheritanceInfo{};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = m_RenderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = m_SwapChainFramebuffers[imageIndex];
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+		throw std::runtime_error("Failed to begin recording secondary command buffer!");
 
 	VkViewport viewport{};
 	viewport.x = 0.0f;
@@ -735,11 +1379,50 @@ void HelloTriangleApplication::RecordCommandBuffer(VkCommandBuffer commandBuffer
 	scissor.extent = m_SwapChainExtent;
 	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	// Until the graphics queue has acquired the indices there is nothing to draw with.
+	if (!m_IndexBufferReady)
+	{
+		m_SkippedDraws += lastDraw - firstDraw;
+		lastDraw = firstDraw;
+	}
+
+	// Secondary command buffers don't inherit any state, so every one binds its own.
+	vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer, 0, VK_INDEX_TYPE_UINT16);
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	uint32_t skippedDraws = 0;
+	for (uint32_t i = firstDraw; i < lastDraw; i++)
+	{
+		const DrawCommand& draw = m_DrawList[i];
+		if (draw.variant >= m_VariantPipelines.size())
+			throw std::runtime_error("Draw uses an unknown shader variant!");
+
+		// Waiting for a pipeline that is still compiling would stall the frame, the draw shows up once it's ready.
+		VkPipeline pipeline = m_VariantPipelines[draw.variant];
+		if (pipeline == VK_NULL_HANDLE)
+		{
+			skippedDraws++;
+			continue;
+		}
+		if (pipeline != boundPipeline)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			boundPipeline = pipeline;
+		}
+
+		// Per-draw constants are a bump allocation and a memcpy, the set stays the same and only the offset changes.
+		RingAllocation constants = m_FrameRing.Push(draw.constants);
+		uint32_t dynamicOffsets[] = { constants.offset, m_FrameRing.GetFrameOffset() };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &m_DescriptorSet, 2, dynamicOffsets);
+
+		vkCmdDrawIndexed(commandBuffer, draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+	}
+
+	m_SkippedDraws += skippedDraws;
 
-	vkCmdEndRenderPass(commandBuffer);
 	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
-		throw std::runtime_error("failed to record command buffer!");
+		throw std::runtime_error("Failed to record secondary command buffer!");
+
+	return commandBuffer;
 }
 
 VkShaderModule HelloTriangleApplication::CreateShaderModule(const std::vector<char>& code)
@@ -750,7 +1433,7 @@ VkShaderModule HelloTriangleApplication::CreateShaderModule(const std::vector<ch
 	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
 
 	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(m_Device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+	if (vkCreateShaderModule(m_Device, &createInfo, m_HostAllocator.Get(VK_OBJECT_TYPE_SHADER_MODULE), &shaderModule) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create shader module!");
 
 	return shaderModule;
@@ -772,47 +1455,245 @@ std::vector<const char*> HelloTriangleApplication::GetRequiredExtensions()
 
 void HelloTriangleApplication::MainLoop()
 {
-	while (!glfwWindowShouldClose(m_Window))
+	// The main thread only pumps OS messages, so a slow message (like a window drag) can't stall a frame.
+	m_Running = true;
+	m_RenderThread = std::thread(&HelloTriangleApplication::RenderLoop, this);
+
+	while (m_Running && !glfwWindowShouldClose(m_Window))
+		glfwWaitEvents();
+
+	m_Running = false;
+	m_RenderThread.join();
+
+	if (m_RenderThreadException)
+		std::rethrow_exception(m_RenderThreadException);
+}
+
+void HelloTriangleApplication::RenderLoop()
+{
+	try
+	{
+		while (m_Running)
+		{
+			ProcessEvents();
+
+			// Don't spin while minimized, there is nothing to present to.
+			if (m_Iconified)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				continue;
+			}
+
+			DrawFrame();
+
+			// Pipelines compiled while running survive a crash as well, Save() does nothing if none were.
+			auto now = std::chrono::steady_clock::now();
+			if (now - m_LastPipelineCacheSave >= s_PipelineCacheSaveInterval)
+			{
+				m_PipelineCache.Save();
+				m_LastPipelineCacheSave = now;
+			}
+		}
+	}
+	catch (...)
 	{
-		glfwPollEvents();
-		DrawFrame();
+		m_RenderThreadException = std::current_exception();
+		m_Running = false;
+		glfwPostEmptyEvent();
 	}
 
+	// Every queue is only used from this thread, so this is the last point where work can be pending.
 	vkDeviceWaitIdle(m_Device);
 }
 
+void HelloTriangleApplication::PushEvent(const WindowEvent& event)
+{
+	// Events are rare enough that a full queue only happens if the render thread is badly stalled, so just wait for it.
+	while (!m_Events.TryPush(event) && m_Running)
+		std::this_thread::yield();
+}
+
+void HelloTriangleApplication::ProcessEvents()
+{
+	while (auto event = m_Events.TryPop())
+	{
+		if (auto resize = std::get_if<FramebufferResizeEvent>(&*event))
+		{
+			m_FramebufferWidth = resize->width;
+			m_FramebufferHeight = resize->height;
+			m_FramebufferResized = true;
+		}
+		else if (auto iconify = std::get_if<IconifyEvent>(&*event))
+			m_Iconified = iconify->iconified;
+		else if (auto key = std::get_if<KeyEvent>(&*event))
+			HandleKey(*key);
+		else if (auto policy = std::get_if<PresentPolicyEvent>(&*event))
+			ApplyPresentPolicy(policy->policy);
+	}
+}
+
+void HelloTriangleApplication::HandleKey(const KeyEvent& event)
+{
+	if (event.action != GLFW_PRESS)
+		return;
+
+	// Escape closes the window, 1-4 switch the present mode, V cycles the shader variants, H prints driver host allocations.
+	PresentPolicy policy = m_PresentPolicy;
+	switch (event.key)
+	{
+	case GLFW_KEY_ESCAPE:
+		glfwSetWindowShouldClose(m_Window, GLFW_TRUE);
+		glfwPostEmptyEvent();
+		return;
+	case GLFW_KEY_1: policy.mode = PresentMode::LowLatency; break;
+	case GLFW_KEY_2: policy.mode = PresentMode::Mailbox; break;
+	case GLFW_KEY_3: policy.mode = PresentMode::Fifo; break;
+	case GLFW_KEY_4: policy.mode = PresentMode::FifoRelaxed; break;
+	case GLFW_KEY_V:
+		for (auto& draw : m_DrawList)
+			draw.variant = (draw.variant + 1) % static_cast<uint32_t>(m_Variants.size());
+		return;
+	case GLFW_KEY_H:
+		PrintHostAllocationStats();
+		return;
+	default: return;
+	}
+
+	ApplyPresentPolicy(policy);
+}
+
+void HelloTriangleApplication::PrintHostAllocationStats()
+{
+	static const char* scopeNames[] = { "Command", "Object", "Cache", "Device", "Instance" };
+
+	HostAllocationStats stats = m_HostAllocator.GetStats();
+	std::cout << "Host allocations (bytes / peak bytes / allocations):\n";
+	for (size_t scope = 0; scope < stats.scopes.size(); scope++)
+		std::cout << "  " << scopeNames[scope] << ": " << stats.scopes[scope].bytes << " / " << stats.scopes[scope].peakBytes
+			<< " / " << stats.scopes[scope].allocations << "\n";
+	for (const auto& [type, counters] : stats.objectTypes)
+		std::cout << "  " << HostAllocator::GetObjectTypeName(type) << " (" << type << "): " << counters.bytes << " / "
+			<< counters.peakBytes << " / " << counters.allocations << "\n";
+	std::cout << "  Internal: " << stats.internal.bytes << " / " << stats.internal.peakBytes << "\n";
+	std::cout << "  Pooled pages: " << stats.pooledBytes << "\n";
+}
+
 void HelloTriangleApplication::Cleanup()
 {
+	// Subsystems wait for their timelines on Destroy(), which only finishes for values that reached a queue.
+	m_SubmitBatcher.Flush();
+	vkDeviceWaitIdle(m_Device);
+
 	if (m_EnableValidationLayers)
-		DestroyDebugUtilsMessengerEXT(m_Instance, m_DebugMessenger, nullptr);
-	vkDestroySemaphore(m_Device, m_ImageAvailableSemaphore, nullptr);
-	vkDestroySemaphore(m_Device, m_RenderFinishedSemaphore, nullptr);
-	vkDestroyFence(m_Device, m_InFlightFence, nullptr);
-	vkDestroyCommandPool(m_Device, m_CommandPool, nullptr);
-	for (auto framebuffer : m_SwapChainFramebuffers)
-		vkDestroyFramebuffer(m_Device, framebuffer, nullptr);
-	vkDestroyPipeline(m_Device, m_GraphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
-	vkDestroyRenderPass(m_Device, m_RenderPass, nullptr);
-	for (auto imageView : m_SwapChainImageViews)
-		vkDestroyImageView(m_Device, imageView, nullptr);
-	vkDestroySwapchainKHR(m_Device, m_SwapChain, nullptr);
-	vkDestroyDevice(m_Device, nullptr);
-	vkDestroySurfaceKHR(m_Instance, m_Surface, nullptr);
-	vkDestroyInstance(m_Instance, nullptr);
+		DestroyDebugUtilsMessengerEXT(m_Instance, m_DebugMessenger, m_HostAllocator.Get(VK_OBJECT_TYPE_DEBUG_UTILS_MESSENGER_EXT));
+	for (auto& frame : m_Frames)
+	{
+		vkDestroySemaphore(m_Device, frame.imageAvailableSemaphore, m_HostAllocator.Get(VK_OBJECT_TYPE_SEMAPHORE));
+		vkDestroySemaphore(m_Device, frame.renderFinishedSemaphore, m_HostAllocator.Get(VK_OBJECT_TYPE_SEMAPHORE));
+		for (auto& allocator : frame.commandAllocators)
+			allocator.Destroy();
+		frame.arena.Destroy();
+	}
+	m_AsyncCompute.Destroy();
+	m_FrameRing.Destroy();
+	vkDestroyDescriptorPool(m_Device, m_DescriptorPool, m_HostAllocator.Get(VK_OBJECT_TYPE_DESCRIPTOR_POOL));
+	m_UploadEngine.Destroy();
+	m_DeletionQueue.Destroy();
+	for (const auto& retired : m_RetiredSwapChains)
+		DestroySwapChainResources(retired.swapChain, retired.imageViews, retired.framebuffers, retired.renderTargets);
+	m_Defragmenter.UnregisterBuffer(m_IndexBufferId);
+	vkDestroyBuffer(m_Device, m_IndexBuffer, m_HostAllocator.Get(VK_OBJECT_TYPE_BUFFER));
+	m_DeviceAllocator.Free(m_IndexAllocation);
+	m_Defragmenter.Destroy();
+	m_GraphicsTimeline.Destroy();
+	DestroySwapChainResources(m_SwapChain, m_SwapChainImageViews, m_SwapChainFramebuffers, { m_ColorTarget, m_DepthTarget });
+	m_DeviceAllocator.Destroy();
+	// Finishes compiles still in flight, their pipelines are destroyed like the ones already in use.
+	m_PipelineCompiler.Destroy();
+	m_PipelineStates.Destroy();
+	vkDestroyShaderModule(m_Device, m_FragShaderModule, m_HostAllocator.Get(VK_OBJECT_TYPE_SHADER_MODULE));
+	vkDestroyShaderModule(m_Device, m_VertShaderModule, m_HostAllocator.Get(VK_OBJECT_TYPE_SHADER_MODULE));
+	vkDestroyPipelineLayout(m_Device, m_PipelineLayout, m_HostAllocator.Get(VK_OBJECT_TYPE_PIPELINE_LAYOUT));
+	vkDestroyDescriptorSetLayout(m_Device, m_DescriptorSetLayout, m_HostAllocator.Get(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT));
+	vkDestroyRenderPass(m_Device, m_RenderPass, m_HostAllocator.Get(VK_OBJECT_TYPE_RENDER_PASS));
+	m_PipelineCache.Destroy();
+	vkDestroyDevice(m_Device, m_HostAllocator.Get(VK_OBJECT_TYPE_DEVICE));
+	vkDestroySurfaceKHR(m_Instance, m_Surface, m_HostAllocator.Get(VK_OBJECT_TYPE_SURFACE_KHR));
+	vkDestroyInstance(m_Instance, m_HostAllocator.Get(VK_OBJECT_TYPE_INSTANCE));
+	m_HostAllocator.Destroy();
 	glfwDestroyWindow(m_Window);
 	glfwTerminate();
 }
 
+void HelloTriangleApplication::FramebufferResizeCallback(GLFWwindow* window, int width, int height)
+{
+	auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+	app->PushEvent(FramebufferResizeEvent{ width, height });
+}
+
+void HelloTriangleApplication::WindowIconifyCallback(GLFWwindow* window, int iconified)
+{
+	auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+	app->PushEvent(IconifyEvent{ iconified == GLFW_TRUE });
+}
+
+void HelloTriangleApplication::KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+	app->PushEvent(KeyEvent{ key, scancode, action, mods });
+}
+
 VKAPI_ATTR VkBool32 VKAPI_CALL HelloTriangleApplication::DebugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData)
 {
 	std::cerr << "Validation layer: " << pCallbackData->pMessage << std::endl;
 	return VK_FALSE;
 }
 
-int main()
+// Reads the present policy from the command line, e.g. --present-mode=fifo --swapchain-images=3 --max-queued-frames=1 --fps-cap=60
+static PresentPolicy ParsePresentPolicy(int argc, char** argv)
+{
+	PresentPolicy policy;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		size_t separator = arg.find('=');
+		if (separator == std::string::npos)
+			continue;
+
+		std::string name = arg.substr(0, separator);
+		std::string value = arg.substr(separator + 1);
+
+		try
+		{
+			if (name == "--present-mode")
+			{
+				if (value == "immediate") policy.mode = PresentMode::LowLatency;
+				else if (value == "mailbox") policy.mode = PresentMode::Mailbox;
+				else if (value == "fifo") policy.mode = PresentMode::Fifo;
+				else if (value == "fifo-relaxed") policy.mode = PresentMode::FifoRelaxed;
+				else std::cerr << "Unknown present mode: " << value << "\n";
+			}
+			else if (name == "--swapchain-images")
+				policy.imageCount = static_cast<uint32_t>(std::stoul(value));
+			else if (name == "--max-queued-frames")
+				policy.maxQueuedFrames = static_cast<uint32_t>(std::stoul(value));
+			else if (name == "--fps-cap")
+				policy.maxFrameRate = std::stod(value);
+		}
+		catch (const std::exception&)
+		{
+			std::cerr << "Ignoring invalid value for " << name << ": " << value << "\n";
+		}
+	}
+
+	return policy;
+}
+
+int main(int argc, char** argv)
 {
 	HelloTriangleApplication app;
+	app.SetPresentPolicy(ParsePresentPolicy(argc, argv));
 
 	try
 	{
@@ -1,4 +1,23 @@
 #include "GLFW/glfw3.h"
+#include "Timeline.h"
+#include "FrameLimiter.h"
+#include "SpscQueue.h"
+#include "ThreadPool.h"
+#include "CommandAllocator.h"
+#include "AsyncCompute.h"
+#include "Barriers.h"
+#include "DeviceAllocator.h"
+#include "UploadEngine.h"
+#include "FrameRingBuffer.h"
+#include "MemoryBudget.h"
+#include "Defragmenter.h"
+#include "HostAllocator.h"
+#include "FrameArena.h"
+#include "DeletionQueue.h"
+#include "PipelineCache.h"
+#include "PipelineCompiler.h"
+#include "PipelineStateCache.h"
+#include "SubmitBatcher.h"
 
 #include <iostream>
 #include <stdexcept>
@@ -8,6 +27,14 @@
 #include <limits>
 #include <algorithm>
 #include <fstream>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <variant>
+#include <exception>
+#include <functional>
+#include <future>
+#include <chrono>
 
 static std::vector<char> ReadFile(const std::string& filename)
 {
@@ -48,6 +75,13 @@ struct QueueFamilyIndices
 {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
+	// Always set once graphicsFamily is. Equal to graphicsFamily only if the device has no other compute capable family.
+	std::optional<uint32_t> computeFamily;
+	// 1 when compute gets a second queue of the graphics family, 0 when it has a family (or the graphics queue) to itself.
+	uint32_t computeQueueIndex = 0;
+	// Always set once graphicsFamily is. Equal to graphicsFamily only if the device has no transfer-only family.
+	std::optional<uint32_t> transferFamily;
+	uint32_t transferQueueIndex = 0;
 	bool IsComplete()
 	{
 		return graphicsFamily.has_value() && presentFamily.has_value();
@@ -61,10 +95,163 @@ struct SwapChainSupportDetails
 	std::vector<VkPresentModeKHR> presentModes;
 };
 
+// Everything a single frame in flight needs, so the CPU can record frame N+1 while the GPU is still busy with frame N.
+struct FrameData
+{
+	// Primary command buffer of the frame currently recorded in this slot.
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	// One allocator per recording job, since a command pool may only be used by one thread at a time.
+	// The first one also provides the primary command buffer. All of them are reset once the slot comes around again.
+	std::vector<CommandAllocator> commandAllocators;
+	// CPU data of the frame being recorded, reset together with the command allocators.
+	FrameArena arena;
+	VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
+	VkSemaphore renderFinishedSemaphore = VK_NULL_HANDLE;
+	// Graphics timeline value signaled by this slot's last submission.
+	uint64_t submittedValue = 0;
+};
+
+// Per-draw uniform data, matches the DrawConstants block in Triangle.vert (std140).
+struct DrawConstants
+{
+	float offset[2] = { 0.0f, 0.0f };
+	float scale = 1.0f;
+	float padding = 0.0f;
+};
+
+// constant_id of the specialization constants in Triangle.vert and Triangle.frag.
+enum TriangleConstant : uint32_t
+{
+	VertexColors = 0,
+	Monochrome = 1,
+	ColorLevels = 2
+};
+
+// One permutation of the triangle shaders, turned into specialization constants so all of them share one SPIR-V
+// module per stage. Defaults match the defaults in the shaders.
+struct TriangleVariant
+{
+	bool vertexColors = true;
+	bool monochrome = false;
+	// Color steps per channel, 0 keeps the full gradient.
+	uint32_t colorLevels = 0;
+};
+
+struct DrawCommand
+{
+	uint32_t indexCount;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t firstInstance;
+	DrawConstants constants = {};
+	// Index into the app's variant list.
+	uint32_t variant = 0;
+};
+
+// Counters for the last frame drawn, to check that the steady state stays cheap.
+struct FrameStats
+{
+	// Command buffers the driver had to allocate, 0 once every frame slot has warmed up.
+	uint32_t commandBufferAllocations = 0;
+	uint64_t totalCommandBufferAllocations = 0;
+	// vkQueueSubmit2 calls, at most one per queue used, and the submissions batched into them.
+	uint32_t queueSubmits = 0;
+	uint32_t submissions = 0;
+	uint64_t totalQueueSubmits = 0;
+	// Bytes handed to the transfer queue, the copy commands they took, and bytes per second over the frame time.
+	uint64_t uploadBytes = 0;
+	uint32_t uploadCopyCommands = 0;
+	double uploadBandwidth = 0.0;
+	// Streamable resources evicted to stay within the memory budget.
+	uint32_t evictions = 0;
+	// Bytes the defragmenter has moved and device memory blocks it has given back, both since startup.
+	uint64_t totalDefragBytesMoved = 0;
+	uint32_t totalDefragBlocksReleased = 0;
+	// Frame arena bytes used, and heap allocations it fell back to, 0 in the steady state.
+	size_t frameArenaBytes = 0;
+	uint32_t frameArenaOverflows = 0;
+	// Draws left out because their pipeline was still compiling or their indices not uploaded yet, and the compiles
+	// still queued or running.
+	uint32_t skippedDraws = 0;
+	uint32_t pendingPipelines = 0;
+};
+
+enum class PresentMode
+{
+	LowLatency,		// VK_PRESENT_MODE_IMMEDIATE_KHR, may tear.
+	Mailbox,		// VK_PRESENT_MODE_MAILBOX_KHR
+	Fifo,			// VK_PRESENT_MODE_FIFO_KHR, always supported.
+	FifoRelaxed		// VK_PRESENT_MODE_FIFO_RELAXED_KHR, tears instead of waiting when a frame is late.
+};
+
+// How the swap chain trades latency against power. Can be changed at runtime with SetPresentPolicy().
+struct PresentPolicy
+{
+	PresentMode mode = PresentMode::Mailbox;
+	// Number of swap chain images to ask for, 0 picks one more than the surface minimum.
+	uint32_t imageCount = 0;
+	// Frames the CPU may queue ahead of the display, 0 allows one per frame in flight.
+	uint32_t maxQueuedFrames = 0;
+	// CPU side frame rate cap, 0 leaves the frame rate uncapped.
+	double maxFrameRate = 0.0;
+};
+
+// Events the main thread forwards to the render thread.
+struct FramebufferResizeEvent { int width, height; };
+struct IconifyEvent { bool iconified; };
+struct KeyEvent { int key, scancode, action, mods; };
+struct PresentPolicyEvent { PresentPolicy policy; };
+using WindowEvent = std::variant<FramebufferResizeEvent, IconifyEvent, KeyEvent, PresentPolicyEvent>;
+
+// A multisampled color or depth attachment that only lives within the render pass.
+struct RenderTarget
+{
+	VkImage image = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+	Allocation* allocation = nullptr;
+};
+
+// Swap chain resources replaced by a resize. The presentation engine may still be showing the old images after the GPU
+// is done with them, so they are kept until the new swap chain has presented and the frame that did so has passed,
+// instead of stalling the whole device with vkDeviceWaitIdle.
+struct RetiredSwapChain
+{
+	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+	std::vector<VkImageView> imageViews;
+	std::vector<VkFramebuffer> framebuffers;
+	std::vector<RenderTarget> renderTargets;
+};
+
 class HelloTriangleApplication
 {
 public:
+	explicit HelloTriangleApplication(uint32_t maxFramesInFlight = 2);
 	void Run();
+	// Main thread only, it shares the single producer side of the event queue with the window callbacks.
+	void SetPresentPolicy(const PresentPolicy& policy);
+	const PresentPolicy& GetPresentPolicy() const { return m_PresentPolicy; }
+	// Only meaningful on the render thread, which updates it every frame.
+	const FrameStats& GetFrameStats() const { return m_FrameStats; }
+
+	// Render thread only. Submits compute work that overlaps with graphics, e.g. culling for the next frame or
+	// post-processing of the previous one, and returns the compute timeline value it signals. The work goes out with the
+	// frame's next batched submit.
+	// Pass GetGraphicsTimeline().WaitFor() in waits to consume graphics output.
+	uint64_t SubmitCompute(const std::function<void(VkCommandBuffer)>& record, const std::vector<TimelineWait>& waits = {});
+	// Render thread only. Makes the next graphics submission wait, e.g. for GetComputeTimeline().WaitFor(value, stage).
+	void WaitOnGraphics(const TimelineWait& wait);
+	Timeline& GetComputeTimeline() { return m_AsyncCompute.GetTimeline(); }
+	Timeline& GetGraphicsTimeline() { return m_GraphicsTimeline; }
+	const QueueFamilyIndices& GetQueueFamilies() const { return m_QueueFamilies; }
+	// Render thread only. Uploads queued here are flushed with the next frame.
+	UploadEngine& GetUploadEngine() { return m_UploadEngine; }
+	DeviceAllocator& GetDeviceAllocator() { return m_DeviceAllocator; }
+	MemoryBudget& GetMemoryBudget() { return m_MemoryBudget; }
+	// Render thread only, e.g. from eviction callbacks.
+	DeletionQueue& GetDeletionQueue() { return m_DeletionQueue; }
+	// Render thread only.
+	Defragmenter& GetDefragmenter() { return m_Defragmenter; }
 private:
 	bool InitWindow();
 	void InitVulkan();
@@ -76,50 +263,161 @@ private:
 	void PickPhysicalDevice();
 	bool IsDeviceSuitable(VkPhysicalDevice device);
 	bool CheckDeviceExtensionSupport(VkPhysicalDevice device);
+	bool CheckDeviceFeatureSupport(VkPhysicalDevice device);
+	bool IsDeviceExtensionAvailable(VkPhysicalDevice device, const char* extensionName);
 	QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device);
 	SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device);
 	VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
 	VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
 	VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
+	uint32_t ChooseSwapImageCount(const VkSurfaceCapabilitiesKHR& capabilities);
 	void CreateLogicalDevice();
-	void CreateSwapChain();
+	void CreateSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
+	bool RecreateSwapChain();
+	void DestroySwapChainResources(VkSwapchainKHR swapChain, const std::vector<VkImageView>& imageViews, const std::vector<VkFramebuffer>& framebuffers,
+		const std::vector<RenderTarget>& renderTargets);
 	void CreateImageViews();
+	VkSampleCountFlagBits ChooseMsaaSamples();
+	VkFormat FindDepthFormat();
+	void CreateRenderTargets();
+	RenderTarget CreateRenderTarget(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspectMask);
+	void DestroyRenderTarget(const RenderTarget& target);
 	void CreateRenderPass();
+	void CreateDescriptorSetLayout();
 	void CreateGraphicsPipeline();
 	void CreateFramebuffers();
-	void CreateCommandPool();
-	void CreateCommandBuffer();
+	void CreateCommandAllocators();
+	void CreateDescriptorSets();
+	void CreateIndexBuffer();
 	void CreateSyncObjects();
+	void ApplyPresentPolicy(const PresentPolicy& policy);
+	void PushEvent(const WindowEvent& event);
+	void ProcessEvents();
+	void HandleKey(const KeyEvent& event);
+	void PrintHostAllocationStats();
+	void RenderLoop();
+	void PaceFrame();
 	void DrawFrame();
-	void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void RecordCommandBuffer(FrameData& frame, uint32_t imageIndex);
+	VkCommandBuffer RecordDraws(CommandAllocator& allocator, uint32_t imageIndex, uint32_t firstDraw, uint32_t lastDraw);
 	VkShaderModule CreateShaderModule(const std::vector<char>& code);
 	std::vector<const char*> GetRequiredExtensions();
 	void MainLoop();
 	void Cleanup();
+	static void FramebufferResizeCallback(GLFWwindow* window, int width, int height);
+	static void WindowIconifyCallback(GLFWwindow* window, int iconified);
+	static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 	static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData);
 private:
 	GLFWwindow* m_Window;
+	bool m_FramebufferResized = false;
+	// Owned by the render thread, GLFW only allows querying the window from the main thread.
+	int m_FramebufferWidth = 0, m_FramebufferHeight = 0;
+	bool m_Iconified = false;
+	// The thread that constructed the application, GLFW delivers window callbacks on it.
+	std::thread::id m_MainThreadId = std::this_thread::get_id();
+	std::thread m_RenderThread;
+	std::atomic<bool> m_Running = false;
+	std::exception_ptr m_RenderThreadException;
+	SpscQueue<WindowEvent, 256> m_Events;
 	const uint32_t m_WIDTH = 800, m_HEIGHT = 600;
+	// Host memory of every Vulkan object created here. Outlives the instance.
+	HostAllocator m_HostAllocator;
 	VkInstance m_Instance;
 	VkDebugUtilsMessengerEXT m_DebugMessenger;
 	VkSurfaceKHR m_Surface;
 	VkPhysicalDevice m_PhysicalDevice = VK_NULL_HANDLE;
-	VkDevice m_Device;
-	VkQueue m_GraphicsQueue, m_PresentQueue;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkQueue m_GraphicsQueue, m_PresentQueue, m_ComputeQueue, m_TransferQueue;
+	QueueFamilyIndices m_QueueFamilies;
 	VkSwapchainKHR m_SwapChain;
 	std::vector<VkImage> m_SwapChainImages;
 	VkFormat m_SwapChainImageFormat;
 	VkExtent2D m_SwapChainExtent;
 	std::vector<VkImageView> m_SwapChainImageViews;
+	// Resolved into the swap chain image at the end of the render pass, no color target without multisampling.
+	VkSampleCountFlagBits m_MsaaSamples = VK_SAMPLE_COUNT_1_BIT;
+	static constexpr VkSampleCountFlagBits s_MaxMsaaSamples = VK_SAMPLE_COUNT_4_BIT;
+	VkFormat m_DepthFormat;
+	RenderTarget m_ColorTarget, m_DepthTarget;
 	VkRenderPass m_RenderPass;
+	VkDescriptorSetLayout m_DescriptorSetLayout;
 	VkPipelineLayout m_PipelineLayout;
-	VkPipeline m_GraphicsPipeline;
-	VkCommandPool m_CommandPool;
-	VkCommandBuffer m_CommandBuffer;
+	VkShaderModule m_VertShaderModule, m_FragShaderModule;
+	// One pipeline per variant, looked up every frame. VK_NULL_HANDLE until the first compile has finished, and may be
+	// replaced by an optimized link later.
+	// Cycled through with V: the plain triangle, a grayscale one, and one posterized to 4 levels per channel. The last two
+	// only differ in fragment constants and share the pre-rasterization library part.
+	std::vector<TriangleVariant> m_Variants = { {}, { true, true, 0 }, { true, false, 4 } };
+	std::vector<PipelineStateCache::PipelineId> m_VariantPipelineIds;
+	std::vector<VkPipeline> m_VariantPipelines;
+	PipelineCache m_PipelineCache;
+	PipelineCompiler m_PipelineCompiler;
+	// Owns every graphics pipeline, the variant pipelines included.
+	PipelineStateCache m_PipelineStates;
+	static constexpr uint32_t s_PipelineCompileThreadCount = 2;
+	std::chrono::steady_clock::time_point m_LastPipelineCacheSave;
+	static constexpr std::chrono::seconds s_PipelineCacheSaveInterval{ 60 };
 	std::vector<VkFramebuffer> m_SwapChainFramebuffers;
-	VkSemaphore m_ImageAvailableSemaphore;
-	VkSemaphore m_RenderFinishedSemaphore;
-	VkFence m_InFlightFence;
+	const uint32_t m_MaxFramesInFlight;
+	std::vector<FrameData> m_Frames;
+	uint32_t m_CurrentFrame = 0;
+	Timeline m_GraphicsTimeline;
+	// The graphics timeline value of the frame that last rendered to each swap chain image.
+	std::vector<uint64_t> m_ImagesInFlight;
+	FrameStats m_FrameStats;
+	// Empty until the first frame, which has no interval to measure bandwidth over.
+	std::optional<std::chrono::steady_clock::time_point> m_LastFrameTime;
+	// Resources replaced while frames are in flight, destroyed once the graphics timeline has passed their last use.
+	DeletionQueue m_DeletionQueue;
+	// Replaced swap chains waiting for the first present on the current one.
+	std::vector<RetiredSwapChain> m_RetiredSwapChains;
+	// Each queue signals its own timeline, a timeline semaphore can't be signaled out of order from several queues.
+	AsyncCompute m_AsyncCompute;
+	DeviceAllocator m_DeviceAllocator;
+	MemoryBudget m_MemoryBudget;
+	UploadEngine m_UploadEngine;
+	Defragmenter m_Defragmenter;
+	// The triangle's indices in device local memory. Uploaded on the transfer queue, then registered with the
+	// defragmenter, which may move the buffer from one frame to the next.
+	VkBuffer m_IndexBuffer = VK_NULL_HANDLE;
+	Allocation* m_IndexAllocation = nullptr;
+	VkBufferCreateInfo m_IndexBufferInfo{};
+	uint32_t m_IndexBufferFamilies[2] = {};
+	uint64_t m_IndexUploadValue = 0;
+	Defragmenter::MovableId m_IndexBufferId = 0;
+	bool m_IndexBufferReady = false;
+	static constexpr std::chrono::microseconds s_DefragTimeBudget{ 500 };
+	// Per-frame uniform and storage data, bound through one descriptor set with dynamic offsets.
+	FrameRingBuffer m_FrameRing;
+	VkDescriptorPool m_DescriptorPool;
+	VkDescriptorSet m_DescriptorSet;
+	static constexpr VkDeviceSize s_FrameRingBytesPerFrame = 1024 * 1024;
+	static constexpr VkDeviceSize s_DynamicUniformRange = 256;
+	// The storage binding always starts at a frame's region and covers all of it.
+	static constexpr VkDeviceSize s_DynamicStorageRange = s_FrameRingBytesPerFrame;
+	// Cross-queue waits for the next graphics submission.
+	std::vector<TimelineWait> m_GraphicsWaits;
+	std::vector<VkSemaphoreSubmitInfo> m_GraphicsWaitInfos;
+	SubmitBatcher m_SubmitBatcher;
+	PresentPolicy m_PresentPolicy;
+	bool m_PresentPolicyChanged = false;
+	FrameLimiter m_FrameLimiter;
+	// VK_KHR_present_wait lets us pace against the display instead of against GPU completion.
+	bool m_PresentWaitSupported = false;
+	PFN_vkWaitForPresentKHR m_vkWaitForPresentKHR = nullptr;
+	uint64_t m_LastPresentId = 0;
+	// Present ids only count up within one swap chain, so waits must not reach back past a recreation.
+	uint64_t m_FirstPresentId = 1;
+	std::vector<const char*> m_EnabledDeviceExtensions;
+	std::vector<DrawCommand> m_DrawList = { { 3, 1, 0, 0, 0 } };
+	// Draws left out by the recording jobs because their variant's pipeline wasn't ready.
+	std::atomic<uint32_t> m_SkippedDraws = 0;
+	// Recording helpers, the render thread records one range of draws itself.
+	ThreadPool m_WorkerPool;
+	// Below this many draws per job, handing work to another thread costs more than it saves.
+	static constexpr uint32_t s_MinDrawsPerRecordingJob = 256;
+	static constexpr size_t s_FrameArenaSize = 64 * 1024;
 	const std::vector<const char*> m_ValidationLayers = { "VK_LAYER_KHRONOS_validation" };
 	const std::vector<const char*> m_DeviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
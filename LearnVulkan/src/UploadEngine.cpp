@@ -0,0 +1,283 @@
+#include "UploadEngine.h"
+#include "Barriers.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+#include <stdexcept>
+
+// Staging offsets are kept aligned for buffer to image copies of any texel size up to 16 bytes.
+static constexpr VkDeviceSize s_StagingAlignment = 16;
+static constexpr VkDeviceSize s_StagingBlockSize = 8 * 1024 * 1024;
+
+void UploadEngine::Create(DeviceAllocator* allocator, HostAllocator* hostAllocator, VkDevice device, VkQueue queue, uint32_t queueFamilyIndex, uint32_t graphicsFamilyIndex, SubmitBatcher* batcher)
+{
+	m_Allocator = allocator;
+	m_HostAllocator = hostAllocator;
+	m_Device = device;
+	m_Queue = queue;
+	m_Batcher = batcher;
+	m_QueueFamilyIndex = queueFamilyIndex;
+	m_GraphicsFamilyIndex = graphicsFamilyIndex;
+
+	m_Timeline.Create(m_HostAllocator, m_Device);
+	m_StagingBelt.Create(m_Allocator, m_HostAllocator, m_Device, s_StagingBlockSize);
+	m_AcquiredValue = 0;
+}
+
+void UploadEngine::Destroy()
+{
+	m_Timeline.Wait(m_Timeline.GetLastSubmitted());
+
+	for (auto& batch : m_InFlight)
+		ReleaseBatch(batch);
+	m_InFlight.clear();
+
+	for (auto& allocator : m_FreeAllocators)
+		allocator.Destroy();
+	m_FreeAllocators.clear();
+
+	m_Queued.clear();
+	m_StagingBelt.Destroy();
+	m_Timeline.Destroy();
+}
+
+void UploadEngine::UploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, VkSharingMode sharingMode)
+{
+	Copy& copy = QueueCopy(data, size);
+	copy.buffer = buffer;
+	copy.dstOffset = offset;
+	copy.dstStage = dstStage;
+	copy.dstAccess = dstAccess;
+	copy.concurrent = sharingMode == VK_SHARING_MODE_CONCURRENT;
+}
+
+void UploadEngine::UploadImage(VkImage image, VkExtent3D extent, const void* data, VkDeviceSize size,
+	VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	Copy& copy = QueueCopy(data, size);
+	copy.image = image;
+	copy.extent = extent;
+	copy.finalLayout = finalLayout;
+	copy.dstStage = dstStage;
+	copy.dstAccess = dstAccess;
+}
+
+UploadEngine::Copy& UploadEngine::QueueCopy(const void* data, VkDeviceSize size)
+{
+	StagingRange staging = m_StagingBelt.Allocate(size, s_StagingAlignment);
+	memcpy(staging.data, data, size);
+
+	m_PendingBytes += size;
+
+	Copy& copy = m_Queued.emplace_back();
+	copy.stagingBuffer = staging.buffer;
+	copy.stagingOffset = staging.offset;
+	copy.size = size;
+	return copy;
+}
+
+uint64_t UploadEngine::Flush()
+{
+	m_FlushedBytes = 0;
+	m_FlushedCopyCommands = 0;
+
+	if (m_Queued.empty())
+		return 0;
+
+	Batch& batch = m_InFlight.emplace_back();
+	batch.copies = std::move(m_Queued);
+	m_Queued.clear();
+
+	if (!m_FreeAllocators.empty())
+	{
+		batch.commandAllocator = std::move(m_FreeAllocators.back());
+		m_FreeAllocators.pop_back();
+	}
+	else
+		batch.commandAllocator.Create(m_HostAllocator, m_Device, m_QueueFamilyIndex);
+
+	VkCommandBuffer commandBuffer = batch.commandAllocator.Allocate(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+		throw std::runtime_error("Failed to begin recording upload command buffer!");
+
+	m_FlushedCopyCommands = RecordCopies(commandBuffer, batch.copies);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to record upload command buffer!");
+
+	batch.submittedValue = m_Timeline.Next();
+	VkSemaphoreSubmitInfo signalInfo = SubmitBatcher::SemaphoreInfo(m_Timeline.GetSemaphore(), batch.submittedValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+	m_Batcher->Add(m_Queue, { &commandBuffer, 1 }, {}, { &signalInfo, 1 }, &m_Timeline);
+
+	// The staging blocks written for this batch come back once the transfer queue has passed it.
+	m_StagingBelt.Retire(batch.submittedValue);
+
+	for (const auto& copy : batch.copies)
+		m_FlushedBytes += copy.size;
+
+	return batch.submittedValue;
+}
+
+uint32_t UploadEngine::RecordCopies(VkCommandBuffer commandBuffer, const std::vector<Copy>& copies)
+{
+	VkImageSubresourceRange range{};
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.baseMipLevel = 0;
+	range.levelCount = 1;
+	range.baseArrayLayer = 0;
+	range.layerCount = 1;
+
+	// Group the copies by staging block and destination, one copy command per group.
+	struct BufferGroup { VkBuffer src, dst; std::vector<VkBufferCopy> regions; };
+	struct ImageGroup { VkBuffer src; VkImage dst; std::vector<VkBufferImageCopy> regions; };
+	std::vector<BufferGroup> bufferGroups;
+	std::vector<ImageGroup> imageGroups;
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+
+	for (const auto& copy : copies)
+	{
+		if (copy.buffer != VK_NULL_HANDLE)
+		{
+			auto group = std::find_if(bufferGroups.begin(), bufferGroups.end(), [&copy](const BufferGroup& candidate) {
+				return candidate.src == copy.stagingBuffer && candidate.dst == copy.buffer;
+			});
+			if (group == bufferGroups.end())
+				group = bufferGroups.insert(bufferGroups.end(), { copy.stagingBuffer, copy.buffer, {} });
+
+			// Uploads queued back to back are usually contiguous on both sides, those become a single region.
+			VkBufferCopy* last = group->regions.empty() ? nullptr : &group->regions.back();
+			if (last && last->srcOffset + last->size == copy.stagingOffset && last->dstOffset + last->size == copy.dstOffset)
+				last->size += copy.size;
+			else
+				group->regions.push_back({ copy.stagingOffset, copy.dstOffset, copy.size });
+			continue;
+		}
+
+		auto group = std::find_if(imageGroups.begin(), imageGroups.end(), [&copy](const ImageGroup& candidate) {
+			return candidate.src == copy.stagingBuffer && candidate.dst == copy.image;
+		});
+		if (group == imageGroups.end())
+			group = imageGroups.insert(imageGroups.end(), { copy.stagingBuffer, copy.image, {} });
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = copy.stagingOffset;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = copy.extent;
+		group->regions.push_back(region);
+
+		// The previous contents are discarded, the image is overwritten as a whole.
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = copy.image;
+		barrier.subresourceRange = range;
+		imageBarriers.push_back(barrier);
+	}
+
+	if (!imageBarriers.empty())
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+
+	for (const auto& group : bufferGroups)
+		vkCmdCopyBuffer(commandBuffer, group.src, group.dst, static_cast<uint32_t>(group.regions.size()), group.regions.data());
+
+	for (const auto& group : imageGroups)
+		vkCmdCopyBufferToImage(commandBuffer, group.src, group.dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(group.regions.size()), group.regions.data());
+
+	// Ownership moves once per resource, however many uploads it got.
+	std::unordered_set<VkBuffer> releasedBuffers;
+	std::unordered_set<VkImage> releasedImages;
+	for (const auto& copy : copies)
+	{
+		if (copy.buffer != VK_NULL_HANDLE && !releasedBuffers.insert(copy.buffer).second)
+			continue;
+		if (copy.image != VK_NULL_HANDLE && !releasedImages.insert(copy.image).second)
+			continue;
+
+		if (copy.concurrent)
+			continue;
+
+		if (copy.buffer != VK_NULL_HANDLE)
+			RecordBufferRelease(commandBuffer, copy.buffer, m_QueueFamilyIndex, m_GraphicsFamilyIndex,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+		else
+			RecordImageRelease(commandBuffer, copy.image, range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copy.finalLayout,
+				m_QueueFamilyIndex, m_GraphicsFamilyIndex, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+	}
+
+	return static_cast<uint32_t>(bufferGroups.size() + imageGroups.size());
+}
+
+std::optional<TimelineWait> UploadEngine::RecordAcquires(VkCommandBuffer commandBuffer)
+{
+	VkImageSubresourceRange range{};
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.baseMipLevel = 0;
+	range.levelCount = 1;
+	range.baseArrayLayer = 0;
+	range.layerCount = 1;
+
+	// Only batches the transfer queue has already finished, so the wait below never holds up the graphics queue.
+	VkPipelineStageFlags2 waitStages = 0;
+	while (!m_InFlight.empty() && m_Timeline.HasPassed(m_InFlight.front().submittedValue))
+	{
+		Batch& batch = m_InFlight.front();
+		std::unordered_set<VkBuffer> acquiredBuffers;
+		std::unordered_set<VkImage> acquiredImages;
+		for (const auto& copy : batch.copies)
+		{
+			m_PendingBytes -= copy.size;
+			m_TotalBytes += copy.size;
+
+			if (copy.buffer != VK_NULL_HANDLE && !acquiredBuffers.insert(copy.buffer).second)
+				continue;
+			if (copy.image != VK_NULL_HANDLE && !acquiredImages.insert(copy.image).second)
+				continue;
+
+			// For concurrent buffers the semaphore wait alone makes the copy visible.
+			if (copy.buffer != VK_NULL_HANDLE && !copy.concurrent)
+				RecordBufferAcquire(commandBuffer, copy.buffer, m_QueueFamilyIndex, m_GraphicsFamilyIndex, copy.dstStage, copy.dstAccess);
+			else if (copy.image != VK_NULL_HANDLE)
+				RecordImageAcquire(commandBuffer, copy.image, range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copy.finalLayout,
+					m_QueueFamilyIndex, m_GraphicsFamilyIndex, copy.dstStage, copy.dstAccess);
+
+			waitStages |= copy.dstStage;
+		}
+
+		m_AcquiredValue = batch.submittedValue;
+		ReleaseBatch(batch);
+		m_InFlight.pop_front();
+	}
+
+	m_StagingBelt.Reclaim(m_AcquiredValue);
+
+	if (waitStages == 0)
+		return std::nullopt;
+
+	return m_Timeline.WaitFor(m_AcquiredValue, waitStages);
+}
+
+void UploadEngine::ReleaseBatch(Batch& batch)
+{
+	batch.commandAllocator.Reset();
+	m_FreeAllocators.push_back(std::move(batch.commandAllocator));
+}
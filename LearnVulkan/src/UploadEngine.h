@@ -0,0 +1,99 @@
+#pragma once
+
+#include "CommandAllocator.h"
+#include "DeviceAllocator.h"
+#include "StagingBelt.h"
+#include "SubmitBatcher.h"
+#include "Timeline.h"
+
+#include <deque>
+#include <optional>
+#include <vector>
+
+// Copies data from staging memory into device local buffers and images on the transfer queue, so bulk uploads
+// never occupy the graphics queue. Upload data goes straight into reusable staging blocks. Flush() records everything
+// queued since the last flush with one copy command per staging block and destination, merging contiguous ranges,
+// and submits it as a single batch signaling the transfer timeline. Each flush may write a destination range only once.
+// Destinations need VK_*_USAGE_TRANSFER_DST_BIT. Ownership of exclusive ones moves to the graphics family only once the
+// transfer queue has finished, in RecordAcquires(), so the graphics queue never waits on a copy in flight.
+// Like the transfer timeline, an engine must only be used by one thread.
+class UploadEngine
+{
+public:
+	// Batches are submitted through batcher, they reach the GPU with its next flush.
+	void Create(DeviceAllocator* allocator, HostAllocator* hostAllocator, VkDevice device, VkQueue queue, uint32_t queueFamilyIndex, uint32_t graphicsFamilyIndex, SubmitBatcher* batcher);
+	void Destroy();
+
+	// Queue a copy of size bytes of data into buffer at offset. data is copied immediately and may be freed afterwards.
+	// dstStage and dstAccess describe the first graphics use of the buffer. Images are always exclusive, buffers shared
+	// concurrently by the transfer and graphics families skip the ownership transfer.
+	void UploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+		VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, VkSharingMode sharingMode = VK_SHARING_MODE_EXCLUSIVE);
+	// Queue a copy of tightly packed texels into mip level 0 of a 2D color image, which ends up in finalLayout.
+	void UploadImage(VkImage image, VkExtent3D extent, const void* data, VkDeviceSize size,
+		VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	// Hands everything queued since the last flush to the batcher as one batch.
+	// Returns the transfer timeline value of the batch, or 0 if nothing was queued.
+	uint64_t Flush();
+	// Records the ownership acquires of every batch the transfer queue has finished into a graphics command buffer
+	// and frees their staging memory. The returned wait has to be added to that command buffer's submission.
+	std::optional<TimelineWait> RecordAcquires(VkCommandBuffer commandBuffer);
+	// Resources of the upload that Flush() returned value for may be used by graphics submissions that follow the
+	// RecordAcquires() call which made this true.
+	bool IsAcquired(uint64_t value) const { return value <= m_AcquiredValue; }
+
+	Timeline& GetTimeline() { return m_Timeline; }
+	// Staging bytes queued or in flight, and total bytes uploaded.
+	VkDeviceSize GetPendingBytes() const { return m_PendingBytes; }
+	uint64_t GetTotalBytes() const { return m_TotalBytes; }
+	// Bytes and copy commands of the last Flush().
+	VkDeviceSize GetFlushedBytes() const { return m_FlushedBytes; }
+	uint32_t GetFlushedCopyCommands() const { return m_FlushedCopyCommands; }
+	const StagingBelt& GetStagingBelt() const { return m_StagingBelt; }
+private:
+	struct Copy
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceSize dstOffset = 0;
+		VkExtent3D extent{};
+		VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		VkDeviceSize stagingOffset = 0;
+		VkDeviceSize size = 0;
+		VkPipelineStageFlags dstStage = 0;
+		VkAccessFlags dstAccess = 0;
+		bool concurrent = false;
+	};
+
+	struct Batch
+	{
+		std::vector<Copy> copies;
+		CommandAllocator commandAllocator;
+		uint64_t submittedValue = 0;
+	};
+private:
+	Copy& QueueCopy(const void* data, VkDeviceSize size);
+	uint32_t RecordCopies(VkCommandBuffer commandBuffer, const std::vector<Copy>& copies);
+	void ReleaseBatch(Batch& batch);
+private:
+	DeviceAllocator* m_Allocator = nullptr;
+	HostAllocator* m_HostAllocator = nullptr;
+	VkDevice m_Device = VK_NULL_HANDLE;
+	VkQueue m_Queue = VK_NULL_HANDLE;
+	SubmitBatcher* m_Batcher = nullptr;
+	uint32_t m_QueueFamilyIndex = 0;
+	uint32_t m_GraphicsFamilyIndex = 0;
+	Timeline m_Timeline;
+	StagingBelt m_StagingBelt;
+	std::vector<Copy> m_Queued;
+	// Submitted batches in timeline order, and spare allocators of retired ones.
+	std::deque<Batch> m_InFlight;
+	std::vector<CommandAllocator> m_FreeAllocators;
+	uint64_t m_AcquiredValue = 0;
+	VkDeviceSize m_PendingBytes = 0;
+	uint64_t m_TotalBytes = 0;
+	VkDeviceSize m_FlushedBytes = 0;
+	uint32_t m_FlushedCopyCommands = 0;
+};